@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Writes a forest scene to stdout: a grid of instances of one tree, a box
+trunk and a mesh crown, on a ground plane lit by a large light overhead.
+
+    python3 scenes/forest.py > /tmp/forest.scene
+    python3 scenes/forest.py 300 > /tmp/forest_90k.scene
+
+The argument is the number of trees along each side of the grid, 20 by
+default. Every tree shares one BVH, so even large forests load quickly and
+take little memory. The crown mesh is referred to by its absolute path, so
+the scene can be written anywhere.
+"""
+
+import math
+import os
+import random
+import sys
+
+SPACING = 300.0
+JITTER = 60.0
+
+HEADER = """\
+# A forest of {count} instances of one tree, a box trunk and a mesh crown,
+# on a ground plane lit by a large light overhead.
+camera 0 {camera_y:.1f} {camera_z:.1f}  {corner_x:.3f} {corner_y:.3f} {corner_z:.3f}  1000 0 0  -0.000 928.477 371.391
+
+texture ground constant 0.5 0.45 0.35
+texture bark constant 0.35 0.2 0.1
+texture leaves constant 0.15 0.5 0.15
+texture sky constant 4 4 4
+material ground lambertian ground
+material bark lambertian bark
+material leaves lambertian leaves
+material sky light sky
+
+transform 0 0 0  -90 0 0  1 1 1
+rect ground {ground_min:.0f} {ground_min:.0f} {ground_max:.0f} {ground_max:.0f} 0
+sphere sky 0 40000 0 20000
+
+object tree
+box bark -15 0 -15 15 150 15
+transform 0 250 0  0 0 0  1 1 1
+mesh leaves {mesh}
+end
+"""
+
+
+def main():
+    side = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+    if side < 1:
+        sys.exit("usage: forest.py [trees along each side]")
+
+    random.seed(1)
+    half_width = SPACING * side / 2.0
+    # The camera backs away along its view direction so that larger
+    # forests still fit in the image.
+    camera_scale = side / 20.0
+    camera_y, camera_z = 1800.0 * camera_scale, -4500.0 * camera_scale
+    mesh = os.path.join(os.path.dirname(os.path.abspath(__file__)), "icosphere.obj")
+
+    out = sys.stdout
+    out.write(HEADER.format(count=side * side,
+                            camera_y=camera_y,
+                            camera_z=camera_z,
+                            corner_x=-500.0,
+                            corner_y=camera_y - 835.629,
+                            corner_z=camera_z + 742.781,
+                            ground_min=-2.0 * half_width,
+                            ground_max=2.0 * half_width,
+                            mesh=mesh))
+
+    for i in range(side):
+        for j in range(side):
+            x = -half_width + SPACING * (i + 0.5) + random.uniform(-JITTER, JITTER)
+            z = -half_width + SPACING * (j + 0.5) + random.uniform(-JITTER, JITTER)
+            angle = random.uniform(0.0, 360.0)
+            out.write("\ntransform {:.1f} 0 {:.1f}  0 {:.1f} 0  1 1 1\ninstance tree".format(x, z, angle))
+
+    out.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,32 @@
+#include "aabb.h"
+
+Vec3 AABB::centroid() const {
+    return 0.5 * (min + max);
+}
+
+float AABB::surface_area() const {
+    if (is_empty()) {
+        return 0.0;
+    }
+
+    Vec3 d = max - min;
+    return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+int AABB::longest_axis() const {
+    Vec3 d = max - min;
+
+    if (d.x > d.y && d.x > d.z) {
+        return 0;
+    }
+    else if (d.y > d.z) {
+        return 1;
+    }
+    else {
+        return 2;
+    }
+}
+
+bool AABB::is_empty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cfloat>
+
+#include "vec3.h"
+
+// fminf and fmaxf are library calls unless NaNs are ruled out at compile
+// time, while these compile to single instructions. They differ only in
+// which argument a NaN returns.
+inline float min_float(float a, float b) {
+    return a < b ? a : b;
+}
+
+inline float max_float(float a, float b) {
+    return a > b ? a : b;
+}
+
+class AABB {
+    public:
+        Vec3 min, max;
+
+        AABB() {
+            this->min = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+            this->max = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        };
+
+        AABB(const Vec3 &min, const Vec3 &max) {
+            this->min = min;
+            this->max = max;
+        };
+
+        Vec3 centroid() const;
+        float surface_area() const;
+        int longest_axis() const;
+        bool is_empty() const;
+
+        // Inline since BVH builds spend most of their time here.
+        static AABB merge(const AABB &a, const AABB &b) {
+            return AABB(Vec3(min_float(a.min.x, b.min.x), min_float(a.min.y, b.min.y), min_float(a.min.z, b.min.z)),
+                        Vec3(max_float(a.max.x, b.max.x), max_float(a.max.y, b.max.y), max_float(a.max.z, b.max.z)));
+        };
+
+        static AABB merge(const AABB &a, const Vec3 &p) {
+            return AABB(Vec3(min_float(a.min.x, p.x), min_float(a.min.y, p.y), min_float(a.min.z, p.z)),
+                        Vec3(max_float(a.max.x, p.x), max_float(a.max.y, p.y), max_float(a.max.z, p.z)));
+        };
+};
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <chrono>
+
+#include "bvh_tree.h"
+
+#define BVH_NUM_BINS 16
+#define BVH_MAX_SAH_DEPTH 64
+
+// The builder partitions copies of the boxes rather than indices into them,
+// so that every pass over a node's primitives reads memory in order.
+struct BVHPrimitive {
+    AABB box;
+    Vec3 centroid;
+    int index;
+};
+
+class BVHBuilder {
+    public:
+        std::vector<BVHPrimitive> primitives;
+        std::vector<BVHNode> &nodes;
+        int max_leaf_size, depth;
+
+        BVHBuilder(int max_leaf_size, std::vector<BVHNode> &nodes) : nodes(nodes) {
+            this->max_leaf_size = max_leaf_size;
+            this->depth = 0;
+        };
+
+        int build(int start, int end, int depth);
+};
+
+int build_bvh(const std::vector<AABB> &boxes, int max_leaf_size, std::vector<BVHNode> &nodes, std::vector<int> &indices) {
+    int n = boxes.size();
+    BVHBuilder builder(max_leaf_size, nodes);
+
+    builder.primitives.resize(n);
+    for (int i = 0; i < n; i++) {
+        builder.primitives[i].box = boxes[i];
+        builder.primitives[i].centroid = boxes[i].centroid();
+        builder.primitives[i].index = i;
+    }
+
+    nodes.clear();
+    nodes.reserve(2 * n);
+
+    if (n > 0) {
+        builder.build(0, n, 1);
+    }
+
+    indices.resize(n);
+    for (int i = 0; i < n; i++) {
+        indices[i] = builder.primitives[i].index;
+    }
+
+    return builder.depth;
+}
+
+BVHTree::BVHTree(const std::vector<Hitable*> &hitables, int max_leaf_size) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    this->type = HITABLE_BVH;
+    this->max_leaf_size = max_leaf_size;
+
+    int n = hitables.size();
+    std::vector<AABB> boxes(n);
+    std::vector<int> indices;
+
+    for (int i = 0; i < n; i++) {
+        boxes[i] = hitables[i]->bounding_box();
+    }
+
+    this->depth = build_bvh(boxes, max_leaf_size, nodes, indices);
+
+    for (int i = 0; i < n; i++) {
+        primitives.add(hitables[indices[i]]);
+    }
+
+    auto end_time = std::chrono::steady_clock::now();
+    build_time = std::chrono::duration<double>(end_time - start_time).count();
+}
+
+// Binned surface area heuristic, see "On fast Construction of SAH-based
+// Bounding Volume Hierarchies" (Wald 2007).
+int BVHBuilder::build(int start, int end, int depth) {
+    int index = nodes.size();
+    nodes.push_back(BVHNode());
+
+    AABB box, centroid_box;
+    for (int i = start; i < end; i++) {
+        box = AABB::merge(box, primitives[i].box);
+        centroid_box = AABB::merge(centroid_box, primitives[i].centroid);
+    }
+
+    nodes[index].box = box;
+    nodes[index].axis = 0;
+    this->depth = std::max(this->depth, depth);
+
+    int count = end - start;
+    int axis = centroid_box.longest_axis();
+    float axis_min = centroid_box.min[axis];
+    float axis_extent = centroid_box.max[axis] - axis_min;
+    int mid = start;
+
+    if (count <= 1 || (count <= max_leaf_size && axis_extent <= 0.0)) {
+        nodes[index].offset = start;
+        nodes[index].count = count;
+        return index;
+    }
+
+    if (axis_extent > 0.0 && depth < BVH_MAX_SAH_DEPTH) {
+        float bin_scale = BVH_NUM_BINS / axis_extent;
+        int bin_counts[BVH_NUM_BINS] = { 0 };
+        AABB bin_boxes[BVH_NUM_BINS];
+
+        for (int i = start; i < end; i++) {
+            int b = (int) ((primitives[i].centroid[axis] - axis_min) * bin_scale);
+            b = std::min(b, BVH_NUM_BINS - 1);
+            bin_counts[b]++;
+            bin_boxes[b] = AABB::merge(bin_boxes[b], primitives[i].box);
+        }
+
+        float right_areas[BVH_NUM_BINS];
+        int right_counts[BVH_NUM_BINS];
+        AABB right_box;
+        int right_count = 0;
+
+        for (int b = BVH_NUM_BINS - 1; b > 0; b--) {
+            right_box = AABB::merge(right_box, bin_boxes[b]);
+            right_count += bin_counts[b];
+            right_areas[b] = right_box.surface_area();
+            right_counts[b] = right_count;
+        }
+
+        float best_cost = FLT_MAX;
+        int best_split = -1;
+        AABB left_box;
+        int left_count = 0;
+
+        for (int b = 0; b < BVH_NUM_BINS - 1; b++) {
+            left_box = AABB::merge(left_box, bin_boxes[b]);
+            left_count += bin_counts[b];
+
+            if (left_count == 0 || right_counts[b + 1] == 0) {
+                continue;
+            }
+
+            float cost = left_count * left_box.surface_area() + right_counts[b + 1] * right_areas[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        float area = box.surface_area();
+        float leaf_cost = count;
+        float split_cost = area > 0.0 ? 1.0 + best_cost / area : FLT_MAX;
+
+        if (count <= max_leaf_size && leaf_cost <= split_cost) {
+            nodes[index].offset = start;
+            nodes[index].count = count;
+            return index;
+        }
+
+        if (best_split >= 0) {
+            BVHPrimitive *middle = std::partition(&primitives[start], &primitives[end - 1] + 1, [&](const BVHPrimitive &p) {
+                int b = (int) ((p.centroid[axis] - axis_min) * bin_scale);
+                return std::min(b, BVH_NUM_BINS - 1) <= best_split;
+            });
+            mid = middle - &primitives[0];
+        }
+    }
+
+    if (mid <= start || mid >= end) {
+        mid = (start + end) / 2;
+        std::nth_element(&primitives[start], &primitives[mid], &primitives[end - 1] + 1, [&](const BVHPrimitive &a, const BVHPrimitive &b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+    }
+
+    build(start, mid, depth + 1);
+    int second = build(mid, end, depth + 1);
+
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = axis;
+    return index;
+}
+
+bool BVHTree::intersect(const Ray &ray, float t_max, Hit &hit) {
+    bool did_hit = false;
+
+    traverse_bvh(nodes, ray, t_max, [&](const BVHNode &node) {
+        if (primitives.intersect(node.offset, node.offset + node.count, ray, t_max, hit)) {
+            t_max = hit.t;
+            did_hit = true;
+        }
+        return false;
+    });
+
+    return did_hit;
+}
+
+// Walks the BVH with a coherent packet, near child first along the
+// direction signs its rays share. visit_leaf(node, lanes) is given a mask
+// of the lanes that reach the leaf and may lower t_max_lanes, where a
+// negative t_max drops a lane. It returns true to stop the walk.
+template <class FloatN, class VisitLeaf>
+static void traverse_bvh_packet(const BVHTree *bvh, const RayPacket<FloatN> &packet, float *t_max_lanes, const VisitLeaf &visit_leaf) {
+    const int width = FloatN::width;
+
+    float inv_direction_lanes[3][width];
+    for (int i = 0; i < width; i++) {
+        Vec3 inv_direction = safe_inverse(packet.rays[i].direction);
+        inv_direction_lanes[0][i] = inv_direction.x;
+        inv_direction_lanes[1][i] = inv_direction.y;
+        inv_direction_lanes[2][i] = inv_direction.z;
+    }
+    FloatN inv_direction_x = FloatN::load(inv_direction_lanes[0]);
+    FloatN inv_direction_y = FloatN::load(inv_direction_lanes[1]);
+    FloatN inv_direction_z = FloatN::load(inv_direction_lanes[2]);
+
+    const Ray &first = packet.rays[0];
+    bool direction_is_negative[3] = { first.direction.x < 0.0, first.direction.y < 0.0, first.direction.z < 0.0 };
+
+    FloatN t_max = FloatN::load(t_max_lanes);
+
+    int stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    int node_index = 0;
+
+    while (true) {
+        const BVHNode &node = bvh->nodes[node_index];
+
+        FloatN tx0 = (FloatN(node.box.min.x) - packet.origin_x) * inv_direction_x;
+        FloatN tx1 = (FloatN(node.box.max.x) - packet.origin_x) * inv_direction_x;
+        FloatN ty0 = (FloatN(node.box.min.y) - packet.origin_y) * inv_direction_y;
+        FloatN ty1 = (FloatN(node.box.max.y) - packet.origin_y) * inv_direction_y;
+        FloatN tz0 = (FloatN(node.box.min.z) - packet.origin_z) * inv_direction_z;
+        FloatN tz1 = (FloatN(node.box.max.z) - packet.origin_z) * inv_direction_z;
+
+        FloatN t_near = vmax(vmax(vmin(tx0, tx1), vmin(ty0, ty1)), vmax(vmin(tz0, tz1), FloatN(0.0f)));
+        FloatN t_far = vmin(vmin(vmax(tx0, tx1), vmax(ty0, ty1)), vmin(vmax(tz0, tz1), t_max)) * FloatN(BVH_ROBUST_SCALE);
+        int lanes = (t_near <= t_far).mask();
+
+        if (lanes) {
+            if (node.count > 0) {
+                if (visit_leaf(node, lanes)) {
+                    return;
+                }
+                t_max = FloatN::load(t_max_lanes);
+            }
+            else {
+                if (direction_is_negative[node.axis]) {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                }
+                else {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        node_index = stack[--stack_size];
+    }
+}
+
+template <class FloatN>
+static void bvh_intersect_packet(BVHTree *bvh, const RayPacket<FloatN> &packet, Hit *hits) {
+    const int width = FloatN::width;
+
+    if (bvh->nodes.empty()) {
+        return;
+    }
+
+    // Rays pointing in different directions disagree on the traversal order
+    // and quickly stop sharing nodes, so they are traced one by one.
+    if (!packet.is_coherent()) {
+        for (int i = 0; i < width; i++) {
+            bvh->intersect(packet.rays[i], hits[i].t, hits[i]);
+        }
+        return;
+    }
+
+    float t_max_lanes[width];
+    for (int i = 0; i < width; i++) {
+        t_max_lanes[i] = hits[i].t;
+    }
+
+    traverse_bvh_packet(bvh, packet, t_max_lanes, [&](const BVHNode &node, int) {
+        for (int i = 0; i < node.count; i++) {
+            bvh->primitives.hitables()[node.offset + i]->intersect_packet(packet, hits);
+        }
+
+        for (int i = 0; i < width; i++) {
+            t_max_lanes[i] = hits[i].t;
+        }
+        return false;
+    });
+}
+
+// Lanes reaching a leaf test its primitives one ray at a time with the
+// inline tests, and drop out of the walk once they are blocked.
+template <class FloatN>
+static void bvh_occluded_packet(BVHTree *bvh, const RayPacket<FloatN> &packet, const float *t_max, bool *blocked) {
+    const int width = FloatN::width;
+
+    if (bvh->nodes.empty()) {
+        return;
+    }
+
+    if (!packet.is_coherent()) {
+        for (int i = 0; i < width; i++) {
+            blocked[i] = blocked[i] || bvh->occluded(packet.rays[i], t_max[i]);
+        }
+        return;
+    }
+
+    float t_max_lanes[width];
+    int num_open = 0;
+    for (int i = 0; i < width; i++) {
+        t_max_lanes[i] = blocked[i] ? -1.0f : t_max[i];
+        num_open += !blocked[i];
+    }
+
+    if (num_open == 0) {
+        return;
+    }
+
+    traverse_bvh_packet(bvh, packet, t_max_lanes, [&](const BVHNode &node, int lanes) {
+        for (int i = 0; i < width; i++) {
+            if (((lanes >> i) & 1) && bvh->primitives.occluded(node.offset, node.offset + node.count, packet.rays[i], t_max[i])) {
+                blocked[i] = true;
+                t_max_lanes[i] = -1.0f;
+                num_open--;
+            }
+        }
+        return num_open == 0;
+    });
+}
+
+void BVHTree::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    bvh_intersect_packet(this, packet, hits);
+}
+
+void BVHTree::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    bvh_intersect_packet(this, packet, hits);
+}
+
+void BVHTree::occluded_packet(const RayPacket4 &packet, const float *t_max, bool *blocked) {
+    bvh_occluded_packet(this, packet, t_max, blocked);
+}
+
+void BVHTree::occluded_packet(const RayPacket8 &packet, const float *t_max, bool *blocked) {
+    bvh_occluded_packet(this, packet, t_max, blocked);
+}
+
+// Blockers near the ray origin are found sooner by visiting the near child
+// first, as in intersect().
+bool BVHTree::occluded(const Ray &ray, float t_max) {
+    bool blocked = false;
+
+    traverse_bvh(nodes, ray, t_max, [&](const BVHNode &node) {
+        blocked = primitives.occluded(node.offset, node.offset + node.count, ray, t_max);
+        return blocked;
+    });
+
+    return blocked;
+}
+
+AABB BVHTree::bounding_box() {
+    if (nodes.empty()) {
+        return AABB();
+    }
+
+    return nodes[0].box;
+}
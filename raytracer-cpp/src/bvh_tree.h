@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+
+#include "hitables.h"
+#include "aabb.h"
+
+class BVHNode {
+    public:
+        AABB box;
+        // Interior nodes store the index of their second child in offset (the
+        // first child always follows the parent), leaves store the index of
+        // their first hitable and a non-zero count.
+        int offset;
+        short count;
+        short axis;
+};
+
+#define BVH_STACK_SIZE 128
+#define BVH_ROBUST_SCALE 1.0000004f
+
+// Builds a binned SAH BVH over boxes into nodes. Leaves refer to runs of
+// indices, which is reordered so that each leaf's boxes are contiguous.
+// Returns the depth of the tree.
+int build_bvh(const std::vector<AABB> &boxes, int max_leaf_size, std::vector<BVHNode> &nodes, std::vector<int> &indices);
+
+// Zero direction components are replaced by tiny ones, since 0 * inf in the
+// slab test is NaN for rays that lie in the plane of a box face. With that
+// the slab distances are never NaN.
+inline float safe_inverse(float d) {
+    return 1.0f / (fabs(d) > 1e-30f ? d : copysignf(1e-30f, d));
+}
+
+inline Vec3 safe_inverse(const Vec3 &d) {
+    return Vec3(safe_inverse(d.x), safe_inverse(d.y), safe_inverse(d.z));
+}
+
+// t_far is pushed out by the rounding error the slab distances can have,
+// see "Robust BVH Ray Traversal" (Ize 2013), so that rays grazing an edge
+// or a vertex are not culled by the boxes of the triangles they hit.
+inline bool intersect_box(const AABB &box, const Vec3 &origin, const Vec3 &inv_direction, float t_max) {
+    float tx0 = (box.min.x - origin.x) * inv_direction.x;
+    float tx1 = (box.max.x - origin.x) * inv_direction.x;
+    float ty0 = (box.min.y - origin.y) * inv_direction.y;
+    float ty1 = (box.max.y - origin.y) * inv_direction.y;
+    float tz0 = (box.min.z - origin.z) * inv_direction.z;
+    float tz1 = (box.max.z - origin.z) * inv_direction.z;
+
+    float t_near = max_float(max_float(min_float(tx0, tx1), min_float(ty0, ty1)), max_float(min_float(tz0, tz1), 0.0f));
+    float t_far = min_float(min_float(max_float(tx0, tx1), max_float(ty0, ty1)), min_float(max_float(tz0, tz1), t_max));
+
+    return t_near <= t_far * BVH_ROBUST_SCALE;
+}
+
+// Walks the leaves the ray reaches closer than t_max, nearest child first.
+// visit_leaf(node) may lower t_max as it finds hits, and returns true to
+// end the traversal early.
+template <class LeafVisitor>
+inline void traverse_bvh(const std::vector<BVHNode> &nodes, const Ray &ray, const float &t_max, LeafVisitor visit_leaf) {
+    if (nodes.empty()) {
+        return;
+    }
+
+    Vec3 inv_direction = safe_inverse(ray.direction);
+    bool direction_is_negative[3] = { inv_direction.x < 0.0, inv_direction.y < 0.0, inv_direction.z < 0.0 };
+
+    int stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    int node_index = 0;
+
+    while (true) {
+        const BVHNode &node = nodes[node_index];
+
+        if (intersect_box(node.box, ray.origin, inv_direction, t_max)) {
+            if (node.count > 0) {
+                if (visit_leaf(node)) {
+                    return;
+                }
+            }
+            else {
+                // Visit the child nearest to the ray origin first so that
+                // the far child can be culled against the closest hit.
+                if (direction_is_negative[node.axis]) {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                }
+                else {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        node_index = stack[--stack_size];
+    }
+}
+
+// The hitables are stored in PrimitiveArrays in leaf order, so that every
+// leaf intersects a contiguous run of them with the inline tests.
+class BVHTree : public Hitable {
+    public:
+        PrimitiveArrays primitives;
+        std::vector<BVHNode> nodes;
+        int max_leaf_size, depth;
+        double build_time;
+
+        BVHTree(const std::vector<Hitable*> &hitables, int max_leaf_size = 4);
+
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        bool occluded(const Ray &ray, float t_max);
+        void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        void intersect_packet(const RayPacket8 &packet, Hit *hits);
+        void occluded_packet(const RayPacket4 &packet, const float *t_max, bool *blocked);
+        void occluded_packet(const RayPacket8 &packet, const float *t_max, bool *blocked);
+};
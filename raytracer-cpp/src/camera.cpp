@@ -8,3 +8,10 @@ Ray Camera::create_ray(float u, float v) {
     Vec3 direction = Vec3::normalize((ll + (v * h) + (u * w)) - origin);
     return Ray(origin, direction);
 }
+
+Ray Camera::create_ray(float u, float v, float du, float dv, RayDifferential &differential) {
+    Ray ray = create_ray(u, v);
+    differential.dx_direction = create_ray(u + du, v).direction - ray.direction;
+    differential.dy_direction = create_ray(u, v - dv).direction - ray.direction;
+    return ray;
+}
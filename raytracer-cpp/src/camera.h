@@ -7,6 +7,8 @@ class Camera {
     public:
         Vec3 origin, lower_left, width, height;
 
+        Camera() { };
+
         Camera(const Vec3 &origin, const Vec3 &lower_left, const Vec3 &width, const Vec3 &height) {
             this->origin = origin;
             this->lower_left = lower_left;
@@ -15,4 +17,9 @@ class Camera {
         }
         
         Ray create_ray(float u, float v);
+
+        // Also returns how the direction changes when u grows by du and v
+        // shrinks by dv, the size of a pixel in a top-down image.
+        Ray create_ray(float u, float v, float du, float dv, RayDifferential &differential);
 };
+
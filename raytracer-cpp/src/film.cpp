@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "film.h"
+
+// Each bin holds the largest magnitude the filter reaches inside it, which
+// keeps the weights sample() returns within [-1, 1].
+void Filter::tabulate() {
+    float bin_width = 2.0 * radius / num_bins;
+
+    cdf[0] = 0.0;
+    for (int i = 0; i < num_bins; i++) {
+        bin_values[i] = 0.0;
+        for (int k = 0; k <= 8; k++) {
+            bin_values[i] = fmaxf(bin_values[i], fabs(evaluate(-radius + (i + k / 8.0) * bin_width)));
+        }
+        cdf[i + 1] = cdf[i] + bin_values[i];
+    }
+
+    for (int i = 1; i <= num_bins; i++) {
+        cdf[i] /= cdf[num_bins];
+    }
+}
+
+// Samples each axis from the filter tabulated as a piecewise constant
+// function. The weight corrects for the difference between the filter and
+// the bin's value, and is exactly 1 for the box filter.
+Vec2 Filter::sample(const Vec2 &u, float &weight) const {
+    float offset[2];
+    float bin_width = 2.0 * radius / num_bins;
+    float uv[2] = { u.x, u.y };
+
+    weight = 1.0;
+
+    for (int axis = 0; axis < 2; axis++) {
+        int low = 0, high = num_bins - 1;
+
+        while (low < high) {
+            int middle = (low + high) / 2;
+
+            if (cdf[middle + 1] <= uv[axis]) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+
+        float width = cdf[low + 1] - cdf[low];
+        float t = width > 0.0 ? (uv[axis] - cdf[low]) / width : 0.5;
+        offset[axis] = -radius + (low + fminf(t, 1.0)) * bin_width;
+        weight *= evaluate(offset[axis]) / bin_values[low];
+    }
+
+    return Vec2(offset[0], offset[1]);
+}
+
+float BoxFilter::evaluate(float x) const {
+    return fabs(x) <= radius ? 1.0 : 0.0;
+}
+
+float TentFilter::evaluate(float x) const {
+    return fmaxf(0.0, radius - fabs(x));
+}
+
+float GaussianFilter::evaluate(float x) const {
+    float edge = exp(-radius * radius / (2.0 * sigma * sigma));
+    return fmaxf(0.0, exp(-x * x / (2.0 * sigma * sigma)) - edge);
+}
+
+float MitchellFilter::evaluate(float x) const {
+    x = 2.0 * fabs(x) / radius;
+
+    if (x > 2.0) {
+        return 0.0;
+    }
+    else if (x > 1.0) {
+        return ((-b - 6.0 * c) * x * x * x + (6.0 * b + 30.0 * c) * x * x +
+                (-12.0 * b - 48.0 * c) * x + (8.0 * b + 24.0 * c)) / 6.0;
+    }
+
+    return ((12.0 - 9.0 * b - 6.0 * c) * x * x * x + (-18.0 + 12.0 * b + 6.0 * c) * x * x + (6.0 - 2.0 * b)) / 6.0;
+}
+
+Filter *create_filter(const char *name) {
+    if (strcmp(name, "box") == 0) {
+        return new BoxFilter(0.5);
+    }
+    else if (strcmp(name, "tent") == 0) {
+        return new TentFilter(1.0);
+    }
+    else if (strcmp(name, "gaussian") == 0) {
+        return new GaussianFilter(1.5, 0.5);
+    }
+    else if (strcmp(name, "mitchell") == 0) {
+        return new MitchellFilter(2.0, 1.0 / 3.0, 1.0 / 3.0);
+    }
+
+    return nullptr;
+}
+
+Film::Film(int width, int height) {
+    this->width = width;
+    this->height = height;
+    this->tiles_x = (width + tile_mask) >> tile_shift;
+    this->tiles_y = (height + tile_mask) >> tile_shift;
+
+    void *memory = nullptr;
+    if (posix_memalign(&memory, 64, tiles_x * tiles_y * tile_width * tile_width * sizeof(FilmPixel)) != 0) {
+        fprintf(stderr, "Could not allocate a %dx%d film\n", width, height);
+        exit(1);
+    }
+    this->pixels = (FilmPixel*) memory;
+
+    clear();
+}
+
+Film::~Film() {
+    free(pixels);
+}
+
+void Film::clear() {
+    memset(pixels, 0, tiles_x * tiles_y * tile_width * tile_width * sizeof(FilmPixel));
+}
+
+Vec3 Film::pixel_color(int x, int y) const {
+    const FilmPixel &pixel = pixels[pixel_index(x, y)];
+
+    if (pixel.weight == 0.0) {
+        return Vec3(0.0, 0.0, 0.0);
+    }
+
+    float inverse_weight = 1.0 / pixel.weight;
+    return Vec3(pixel.r * inverse_weight, pixel.g * inverse_weight, pixel.b * inverse_weight);
+}
+
+void Film::resolve(float *rgb) const {
+    for (int y = 0; y < height; y++) {
+        float *out = &rgb[3 * (size_t) y * width];
+
+        for (int x = 0; x < width; x++) {
+            Vec3 color = pixel_color(x, y);
+            out[3 * x + 0] = color.x;
+            out[3 * x + 1] = color.y;
+            out[3 * x + 2] = color.z;
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "vec3.h"
+
+// Separable reconstruction filter. Rather than splatting every sample onto
+// the pixels within the radius, camera rays are offset by sample(), which
+// is distributed like the filter, so each sample only touches the pixel it
+// was taken for and tiles never write to each other's pixels.
+class Filter {
+    protected:
+        static const int num_bins = 64;
+        float bin_values[num_bins];
+        float cdf[num_bins + 1];
+
+        // Tabulates the filter for sample(), called by every constructor.
+        void tabulate();
+
+    public:
+        float radius;
+
+        virtual ~Filter() { };
+
+        virtual float evaluate(float x) const = 0;
+
+        // Maps u onto an offset from the pixel center and returns the
+        // sample's weight, proportional to f / pdf and negative where the
+        // filter is.
+        Vec2 sample(const Vec2 &u, float &weight) const;
+};
+
+class BoxFilter : public Filter {
+    public:
+        BoxFilter(float radius) {
+            this->radius = radius;
+            tabulate();
+        };
+
+        float evaluate(float x) const;
+};
+
+class TentFilter : public Filter {
+    public:
+        TentFilter(float radius) {
+            this->radius = radius;
+            tabulate();
+        };
+
+        float evaluate(float x) const;
+};
+
+class GaussianFilter : public Filter {
+    public:
+        float sigma;
+
+        GaussianFilter(float radius, float sigma) {
+            this->radius = radius;
+            this->sigma = sigma;
+            tabulate();
+        };
+
+        float evaluate(float x) const;
+};
+
+// "Reconstruction Filters in Computer Graphics" (Mitchell and Netravali 1988).
+class MitchellFilter : public Filter {
+    public:
+        float b, c;
+
+        MitchellFilter(float radius, float b, float c) {
+            this->radius = radius;
+            this->b = b;
+            this->c = c;
+            tabulate();
+        };
+
+        float evaluate(float x) const;
+};
+
+// Returns nullptr for an unknown name.
+Filter *create_filter(const char *name);
+
+class FilmPixel {
+    public:
+        float r, g, b, weight;
+};
+
+// Accumulates weighted samples in float RGB and keeps them linear, so the
+// same render can be written as HDR or tonemapped in different ways.
+//
+// Pixels are stored in 8x8 tiles of 1 KiB each, aligned to cache lines, so
+// render tiles that are a multiple of 8 pixels wide never write to the same
+// cache line from two threads.
+class Film {
+    private:
+        FilmPixel *pixels;
+        size_t tiles_x, tiles_y;
+
+        size_t pixel_index(int x, int y) const {
+            size_t tile = (y >> tile_shift) * tiles_x + (x >> tile_shift);
+            return (tile << (2 * tile_shift)) + ((y & tile_mask) << tile_shift) + (x & tile_mask);
+        };
+
+    public:
+        static const int tile_shift = 3;
+        static const int tile_width = 1 << tile_shift;
+        static const int tile_mask = tile_width - 1;
+        static const int max_resolution = 16384;
+
+        int width, height;
+
+        // width and height have to be within [1, max_resolution].
+        Film(int width, int height);
+        ~Film();
+
+        Film(const Film &) = delete;
+        Film &operator=(const Film &) = delete;
+
+        void clear();
+
+        void add_sample(int x, int y, const Vec3 &color, float weight) {
+            FilmPixel &pixel = pixels[pixel_index(x, y)];
+
+            pixel.r += weight * color.x;
+            pixel.g += weight * color.y;
+            pixel.b += weight * color.z;
+            pixel.weight += weight;
+        };
+
+        // Weighted average of the pixel's samples.
+        Vec3 pixel_color(int x, int y) const;
+
+        // Writes width * height linear RGB triples, top row first.
+        void resolve(float *rgb) const;
+};
@@ -0,0 +1,37 @@
+#include "hit_record.h"
+
+void Hit::set(float t, Hitable *hitable, int primitive) {
+    this->t = t;
+    this->hitable = hitable;
+    this->primitive = primitive;
+    this->num_instances = 0;
+}
+
+// Solves dpdx = dudx * dpdu + dvdx * dpdv, and the same for dpdy, in the
+// least squares sense by dropping the axis the normal is closest to, as
+// pbrt does.
+void HitRecord::set_texture_footprint(const Vec3 &dpdx, const Vec3 &dpdy) {
+    texture_coord.dx = Vec2(0.0, 0.0);
+    texture_coord.dy = Vec2(0.0, 0.0);
+
+    int axis0 = 0, axis1 = 1;
+    if (fabs(normal.x) > fabs(normal.y) && fabs(normal.x) > fabs(normal.z)) {
+        axis0 = 1;
+        axis1 = 2;
+    }
+    else if (fabs(normal.y) > fabs(normal.z)) {
+        axis1 = 2;
+    }
+
+    float a00 = dpdu[axis0], a01 = dpdv[axis0];
+    float a10 = dpdu[axis1], a11 = dpdv[axis1];
+    float determinant = a00 * a11 - a01 * a10;
+
+    if (fabs(determinant) < 1e-12) {
+        return;
+    }
+
+    float inverse_det = 1.0 / determinant;
+    texture_coord.dx = Vec2((a11 * dpdx[axis0] - a01 * dpdx[axis1]) * inverse_det, (a00 * dpdx[axis1] - a10 * dpdx[axis0]) * inverse_det);
+    texture_coord.dy = Vec2((a11 * dpdy[axis0] - a01 * dpdy[axis1]) * inverse_det, (a00 * dpdy[axis1] - a10 * dpdy[axis0]) * inverse_det);
+}
@@ -1,13 +1,55 @@
 #pragma once
 
+#include <cfloat>
+
 #include "vec3.h"
 #include "material.h"
 
+#define MAX_INSTANCE_DEPTH 4
+
+class Hitable;
+class TransformedHitable;
+
+// The minimal result of an intersection test: enough to pick the closest
+// hit and to compute its HitRecord afterwards. instances holds the
+// TransformedHitables the ray passed through to reach the primitive,
+// innermost first.
+class Hit {
+    public:
+        float t;
+        Hitable *hitable;
+        // Which part of the primitive was hit, e.g. the face of a box.
+        int primitive;
+        // Parametric or barycentric coordinates, for primitives that get
+        // them for free from the intersection test.
+        Vec2 uv;
+        const TransformedHitable *instances[MAX_INSTANCE_DEPTH];
+        int num_instances;
+
+        Hit() {
+            this->t = FLT_MAX;
+            this->hitable = nullptr;
+            this->primitive = 0;
+            this->num_instances = 0;
+        };
+
+        // Records a hit on a primitive, dropping the instances of any hit
+        // this one replaces.
+        void set(float t, Hitable *hitable, int primitive);
+};
+
 class HitRecord {
     public:
         bool did_hit;
         float t;
         Vec3 position, normal;
         Material *material;
-        Vec2 texture_coord;
+        TextureCoord texture_coord;
+        // How position moves with texture_coord.uv, zero on surfaces that
+        // have no parametrization to filter textures along.
+        Vec3 dpdu, dpdv;
+
+        // Fills in the texture_coord differentials from how position moves
+        // between neighbouring pixels.
+        void set_texture_footprint(const Vec3 &dpdx, const Vec3 &dpdy);
 };
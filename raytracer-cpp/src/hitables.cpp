@@ -1,8 +1,97 @@
 #include "hitables.h"
 
-HitRecord Sphere::intersect(const Ray &ray) {
-    HitRecord result;
+template <class FloatN>
+static void intersect_packet_lanes(Hitable *hitable, const RayPacket<FloatN> &packet, Hit *hits) {
+    for (int i = 0; i < FloatN::width; i++) {
+        hitable->intersect(packet.rays[i], hits[i].t, hits[i]);
+    }
+}
+
+template <class FloatN>
+static void occluded_packet_lanes(Hitable *hitable, const RayPacket<FloatN> &packet, const float *t_max, bool *blocked) {
+    for (int i = 0; i < FloatN::width; i++) {
+        blocked[i] = blocked[i] || hitable->occluded(packet.rays[i], t_max[i]);
+    }
+}
+
+template <class FloatN>
+static FloatN packet_t_max(const Hit *hits) {
+    float t_max[FloatN::width];
+
+    for (int i = 0; i < FloatN::width; i++) {
+        t_max[i] = hits[i].t;
+    }
+
+    return FloatN::load(t_max);
+}
+
+void Hitable::finalize(const Ray &, const Hit &, HitRecord &record) {
+    record.did_hit = false;
+}
+
+bool Hitable::occluded(const Ray &ray, float t_max) {
+    Hit hit;
+    return intersect(ray, t_max, hit);
+}
+
+Vec3 Hitable::random_direction(const Vec3 &, const Vec2 &, float &distance) {
+    distance = 0.0;
+    return Vec3(0.0, 0.0, 1.0);
+}
+
+float Hitable::pdf_value(const Vec3 &, const Vec3 &) {
+    return 0.0;
+}
+
+void Hitable::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    intersect_packet_lanes(this, packet, hits);
+}
+
+void Hitable::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    intersect_packet_lanes(this, packet, hits);
+}
+
+void Hitable::occluded_packet(const RayPacket4 &packet, const float *t_max, bool *blocked) {
+    occluded_packet_lanes(this, packet, t_max, blocked);
+}
+
+void Hitable::occluded_packet(const RayPacket8 &packet, const float *t_max, bool *blocked) {
+    occluded_packet_lanes(this, packet, t_max, blocked);
+}
+
+HitRecord Hitable::closest_hit(const Ray &ray) {
+    Hit hit;
 
+    if (intersect(ray, FLT_MAX, hit)) {
+        return finalize_hit(ray, hit);
+    }
+
+    HitRecord record;
+    record.did_hit = false;
+    record.t = FLT_MAX;
+    return record;
+}
+
+HitRecord finalize_hit(const Ray &ray, const Hit &hit) {
+    Ray local_ray = ray;
+
+    for (int i = hit.num_instances - 1; i >= 0; i--) {
+        local_ray = hit.instances[i]->to_local(local_ray);
+    }
+
+    HitRecord record;
+    record.did_hit = true;
+    record.t = hit.t;
+    hit.hitable->finalize(local_ray, hit, record);
+
+    for (int i = 0; i < hit.num_instances; i++) {
+        hit.instances[i]->to_world(record);
+    }
+
+    return record;
+}
+
+bool Sphere::intersect(const Ray &ray, float t_max, Hit &hit) {
     Vec3 ro = ray.origin;
     Vec3 rd = ray.direction;
     Vec3 so = this->position;
@@ -13,60 +102,197 @@ HitRecord Sphere::intersect(const Ray &ray) {
     float det = b * b - 4 * a * c;
 
     if (det < 0.0) {
-        result.did_hit = false;
-        return result;
+        return false;
     }
 
     float t1 = (-b + sqrt(det)) / (2.0 * a);
     float t2 = (-b - sqrt(det)) / (2.0 * a);
     float t = t1 < t2 ? t1 : t2;
 
-    if (t < 0.0) {
-        result.did_hit = false;
-        return result;
+    if (t < 0.0 || t >= t_max) {
+        return false;
     }
 
-    result.did_hit = true;
-    result.t = t;
-    result.position = ray.point_at_time(t);
-    result.normal = Vec3::normalize(result.position - so);
+    hit.set(t, this, 0);
+    return true;
+}
+
+void Sphere::finalize(const Ray &ray, const Hit &hit, HitRecord &result) {
+    result.position = ray.point_at_time(hit.t);
+    result.normal = Vec3::normalize(result.position - position);
     result.material = this->material;
 
     {
-        Vec3 texture_position = (1.0 / this->radius) * result.normal;
-        float phi = atan2(texture_position.z, texture_position.x);
-        float theta = asin(texture_position.y);
+        Vec3 n = result.normal;
+        float phi = atan2(n.z, n.x);
+        float theta = asin(fminf(fmaxf(n.y, -1.0), 1.0));
         float u = 1.0 - (phi + M_PI) / (2.0 * M_PI);
         float v = (theta + (0.5 * M_PI)) / M_PI;
-        result.texture_coord = Vec2(u, v);
+        result.texture_coord = TextureCoord(Vec2(u, v));
+
+        // u runs westwards around the equator and v from pole to pole. The
+        // clamp keeps dpdv finite at the poles.
+        float cos_theta = fmaxf(cos(theta), 1e-4);
+        result.dpdu = (-2.0 * M_PI * radius) * Vec3(-n.z, 0.0, n.x);
+        result.dpdv = (M_PI * radius) * Vec3(-n.y * n.x / cos_theta, cos_theta, -n.y * n.z / cos_theta);
     }
+}
 
-    return result;
+// Samples the cone of directions the sphere subtends, which unlike sampling
+// its area never wastes samples on the far side.
+Vec3 Sphere::random_direction(const Vec3 &origin, const Vec2 &u, float &distance) {
+    Vec3 to_center = position - origin;
+    float distance_squared = Vec3::dot(to_center, to_center);
+
+    if (distance_squared <= radius * radius) {
+        distance = 0.0;
+        return Vec3(0.0, 0.0, 1.0);
+    }
+
+    float cos_theta_max = sqrt(1.0 - radius * radius / distance_squared);
+    Vec3 direction = Vec3::sample_cone(Vec3::normalize(to_center), cos_theta_max, u.x, u.y);
+
+    Hit hit;
+    distance = intersect(Ray(origin, direction), FLT_MAX, hit) ? hit.t : sqrt(distance_squared) - radius;
+    return direction;
+}
+
+float Sphere::pdf_value(const Vec3 &origin, const Vec3 &direction) {
+    Vec3 to_center = position - origin;
+    float distance_squared = Vec3::dot(to_center, to_center);
+
+    Hit hit;
+    if (distance_squared <= radius * radius || !intersect(Ray(origin, direction), FLT_MAX, hit)) {
+        return 0.0;
+    }
+
+    float cos_theta_max = sqrt(1.0 - radius * radius / distance_squared);
+    return 1.0 / (2.0 * M_PI * (1.0 - cos_theta_max));
 }
 
-HitRecord XYRect::intersect(const Ray &ray) {
-    HitRecord result;
+AABB Sphere::bounding_box() {
+    Vec3 r(radius, radius, radius);
+    return AABB(position - r, position + r);
+}
+
+template <class FloatN>
+static void sphere_intersect_packet(Sphere *sphere, const RayPacket<FloatN> &packet, Hit *hits) {
+    FloatN ocx = packet.origin_x - FloatN(sphere->position.x);
+    FloatN ocy = packet.origin_y - FloatN(sphere->position.y);
+    FloatN ocz = packet.origin_z - FloatN(sphere->position.z);
+
+    FloatN a = packet.direction_x * packet.direction_x + packet.direction_y * packet.direction_y + packet.direction_z * packet.direction_z;
+    FloatN b = FloatN(2.0f) * (packet.direction_x * ocx + packet.direction_y * ocy + packet.direction_z * ocz);
+    FloatN c = ocx * ocx + ocy * ocy + ocz * ocz - FloatN(sphere->radius * sphere->radius);
+    FloatN det = b * b - FloatN(4.0f) * a * c;
 
+    FloatN root = vsqrt(vmax(det, FloatN(0.0f)));
+    FloatN inv_2a = FloatN(1.0f) / (FloatN(2.0f) * a);
+    FloatN t = vmin((FloatN(0.0f) - b + root) * inv_2a, (FloatN(0.0f) - b - root) * inv_2a);
+
+    int mask = ((det >= FloatN(0.0f)) & (t >= FloatN(0.0f)) & (t < packet_t_max<FloatN>(hits))).mask();
+    if (!mask) {
+        return;
+    }
+
+    float ts[FloatN::width];
+    t.store(ts);
+
+    for (int i = 0; i < FloatN::width; i++) {
+        if (mask & (1 << i)) {
+            hits[i].set(ts[i], sphere, 0);
+        }
+    }
+}
+
+void Sphere::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    sphere_intersect_packet(this, packet, hits);
+}
+
+void Sphere::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    sphere_intersect_packet(this, packet, hits);
+}
+
+bool XYRect::intersect(const Ray &ray, float t_max, Hit &hit) {
     float t = ((max.z - ray.origin.z) / ray.direction.z) - 0.0001;
     Vec3 position = ray.point_at_time(t);
 
-    if (t < 0.0 || position.x < min.x || position.x > max.x || position.y < min.y || position.y > max.y) {
-        result.did_hit = false;
-        return result;
+    if (t < 0.0 || t >= t_max || position.x < min.x || position.x > max.x || position.y < min.y || position.y > max.y) {
+        return false;
     }
 
-    result.did_hit = true;
-    result.t = t;
+    hit.set(t, this, 0);
+    return true;
+}
+
+void XYRect::finalize(const Ray &ray, const Hit &hit, HitRecord &result) {
+    Vec3 position = ray.point_at_time(hit.t);
+
     result.position = position;
     result.normal = Vec3(0.0, 0.0, 1.0);
     result.material = material;
-    result.texture_coord = Vec2((position.x - min.x) / (max.x - min.x), (position.y - min.y) / (max.y - min.y));
-    return result;
+    result.texture_coord = TextureCoord(Vec2((position.x - min.x) / (max.x - min.x), (position.y - min.y) / (max.y - min.y)));
+    result.dpdu = Vec3(max.x - min.x, 0.0, 0.0);
+    result.dpdv = Vec3(0.0, max.y - min.y, 0.0);
 }
 
-HitRecord Box::intersect(const Ray &ray) {
-    HitRecord result;
+Vec3 XYRect::random_direction(const Vec3 &origin, const Vec2 &u, float &distance) {
+    Vec3 point(min.x + u.x * (max.x - min.x), min.y + u.y * (max.y - min.y), max.z);
+    Vec3 direction = point - origin;
 
+    distance = Vec3::length(direction);
+    return (1.0 / distance) * direction;
+}
+
+// Converts the uniform density over the rect's area to solid angle, counting
+// both faces since lights emit from both.
+float XYRect::pdf_value(const Vec3 &origin, const Vec3 &direction) {
+    Hit hit;
+    if (direction.z == 0.0 || !intersect(Ray(origin, direction), FLT_MAX, hit)) {
+        return 0.0;
+    }
+
+    float distance = hit.t + 0.0001;
+    float area = (max.x - min.x) * (max.y - min.y);
+    return distance * distance / (fabs(direction.z) * area);
+}
+
+AABB XYRect::bounding_box() {
+    return AABB(Vec3(min.x, min.y, max.z - 0.001), Vec3(max.x, max.y, max.z + 0.001));
+}
+
+template <class FloatN>
+static void xy_rect_intersect_packet(XYRect *rect, const RayPacket<FloatN> &packet, Hit *hits) {
+    FloatN t = (FloatN(rect->max.z) - packet.origin_z) / packet.direction_z - FloatN(0.0001f);
+    FloatN x = packet.origin_x + t * packet.direction_x;
+    FloatN y = packet.origin_y + t * packet.direction_y;
+
+    int mask = ((t >= FloatN(0.0f)) & (t < packet_t_max<FloatN>(hits)) &
+                (x >= FloatN(rect->min.x)) & (x <= FloatN(rect->max.x)) &
+                (y >= FloatN(rect->min.y)) & (y <= FloatN(rect->max.y))).mask();
+    if (!mask) {
+        return;
+    }
+
+    float ts[FloatN::width];
+    t.store(ts);
+
+    for (int i = 0; i < FloatN::width; i++) {
+        if (mask & (1 << i)) {
+            hits[i].set(ts[i], rect, 0);
+        }
+    }
+}
+
+void XYRect::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    xy_rect_intersect_packet(this, packet, hits);
+}
+
+void XYRect::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    xy_rect_intersect_packet(this, packet, hits);
+}
+
+bool Box::intersect(const Ray &ray, float t_max, Hit &hit) {
     float t0x = (min.x - ray.origin.x) / ray.direction.x;
     float t1x = (max.x - ray.origin.x) / ray.direction.x;
 
@@ -98,7 +324,6 @@ HitRecord Box::intersect(const Ray &ray) {
     float t1 = t1x;
 
     int t0_index = 0;
-    int t1_index = 0;
 
     if (t0y > t0) {
         t0 = t0y;
@@ -106,7 +331,6 @@ HitRecord Box::intersect(const Ray &ray) {
     }
     if (t1y < t1) {
         t1 = t1y;
-        t1_index = 1;
     }
 
     if (t0z > t0) {
@@ -115,85 +339,396 @@ HitRecord Box::intersect(const Ray &ray) {
     }
     if (t1z < t1) {
         t1 = t1z;
-        t1_index = 2;
     }
 
-    if (t0 < 0.0 || t0 > t1) {
-        result.did_hit = false;
-        return result;
+    if (t0 < 0.0 || t0 > t1 || t0 - 0.0001 >= t_max) {
+        return false;
     }
 
-    if (t0_index == 0) {
+    hit.set(t0 - 0.0001, this, t0_index);
+    return true;
+}
+
+void Box::finalize(const Ray &ray, const Hit &hit, HitRecord &result) {
+    if (hit.primitive == 0) {
         result.normal = Vec3(1.0, 0.0, 0.0);
     }
-    else if (t0_index == 1) {
+    else if (hit.primitive == 1) {
         result.normal = Vec3(0.0, 1.0, 0.0);
     }
-    else if (t0_index == 2) {
+    else if (hit.primitive == 2) {
         result.normal = Vec3(0.0, 0.0, 1.0);
     }
 
     if (Vec3::dot(result.normal, ray.direction) > 0.0) {
         result.normal = -1.0 * result.normal;
     }
-    
-    result.did_hit = true;
-    result.t = t0 - 0.0001;
-    result.position = ray.point_at_time(t0 - 0.0001);
+
+    result.position = ray.point_at_time(hit.t);
     result.material = this->material;
-    result.texture_coord = Vec2(0.0, 0.0);
+    result.texture_coord = TextureCoord(Vec2(0.0, 0.0));
+}
 
-    return result;
+AABB Box::bounding_box() {
+    return AABB(min, max);
+}
+
+template <class FloatN>
+static void box_intersect_packet(Box *box, const RayPacket<FloatN> &packet, Hit *hits) {
+    FloatN ax = (FloatN(box->min.x) - packet.origin_x) / packet.direction_x;
+    FloatN bx = (FloatN(box->max.x) - packet.origin_x) / packet.direction_x;
+    FloatN ay = (FloatN(box->min.y) - packet.origin_y) / packet.direction_y;
+    FloatN by = (FloatN(box->max.y) - packet.origin_y) / packet.direction_y;
+    FloatN az = (FloatN(box->min.z) - packet.origin_z) / packet.direction_z;
+    FloatN bz = (FloatN(box->max.z) - packet.origin_z) / packet.direction_z;
+
+    FloatN t0x = vmin(ax, bx), t1x = vmax(ax, bx);
+    FloatN t0y = vmin(ay, by), t1y = vmax(ay, by);
+    FloatN t0z = vmin(az, bz), t1z = vmax(az, bz);
+
+    FloatN t0 = t0x;
+    FloatN t0_index = FloatN(0.0f);
+
+    FloatN y_is_entry = t0y > t0;
+    t0 = FloatN::select(y_is_entry, t0y, t0);
+    t0_index = FloatN::select(y_is_entry, FloatN(1.0f), t0_index);
+
+    FloatN z_is_entry = t0z > t0;
+    t0 = FloatN::select(z_is_entry, t0z, t0);
+    t0_index = FloatN::select(z_is_entry, FloatN(2.0f), t0_index);
+
+    FloatN t1 = vmin(vmin(t1x, t1y), t1z);
+    FloatN t = t0 - FloatN(0.0001f);
+
+    int mask = ((t0 >= FloatN(0.0f)) & (t0 <= t1) & (t < packet_t_max<FloatN>(hits))).mask();
+    if (!mask) {
+        return;
+    }
+
+    float ts[FloatN::width], indices[FloatN::width];
+    t.store(ts);
+    t0_index.store(indices);
+
+    for (int i = 0; i < FloatN::width; i++) {
+        if (mask & (1 << i)) {
+            hits[i].set(ts[i], box, (int) indices[i]);
+        }
+    }
+}
+
+void Box::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    box_intersect_packet(this, packet, hits);
 }
 
-HitRecord TransformedHitable::intersect(const Ray &ray) {
+void Box::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    box_intersect_packet(this, packet, hits);
+}
+
+Ray TransformedHitable::to_local(const Ray &ray) const {
+    return world_to_object.transform_ray(ray);
+}
+
+void TransformedHitable::to_world(HitRecord &record) const {
+    record.position = object_to_world.transform_point(record.position);
+    record.normal = Vec3::normalize(normal_to_world.transform_vector(record.normal));
+    record.dpdu = object_to_world.transform_vector(record.dpdu);
+    record.dpdv = object_to_world.transform_vector(record.dpdv);
+}
+
+// Hits nested deeper than MAX_INSTANCE_DEPTH transforms are dropped.
+bool TransformedHitable::push_instance(Hit &hit) const {
+    if (hit.num_instances >= MAX_INSTANCE_DEPTH) {
+        return false;
+    }
+
+    hit.instances[hit.num_instances++] = this;
+    return true;
+}
+
+bool TransformedHitable::intersect(const Ray &ray, float t_max, Hit &hit) {
     if (!hitable) {
-        HitRecord record;
-        record.did_hit = false;
-        return record;
+        return false;
     }
 
-    Ray transformed_ray(ray);
+    Hit local_hit;
 
-    transformed_ray.origin = transformed_ray.origin - translation;
+    if (!hitable->intersect(to_local(ray), t_max, local_hit) || !push_instance(local_hit)) {
+        return false;
+    }
 
-    transformed_ray.origin = Vec3::rotate_x(transformed_ray.origin, cos_theta_x, -sin_theta_x);
-    transformed_ray.direction = Vec3::rotate_x(transformed_ray.direction, cos_theta_x, -sin_theta_x);
+    hit = local_hit;
+    return true;
+}
 
-    transformed_ray.origin = Vec3::rotate_y(transformed_ray.origin, cos_theta_y, -sin_theta_y);
-    transformed_ray.direction = Vec3::rotate_y(transformed_ray.direction, cos_theta_y, -sin_theta_y);
+bool TransformedHitable::occluded(const Ray &ray, float t_max) {
+    return hitable && hitable->occluded(to_local(ray), t_max);
+}
 
-    transformed_ray.origin = Vec3::rotate_z(transformed_ray.origin, cos_theta_z, -sin_theta_z);
-    transformed_ray.direction = Vec3::rotate_z(transformed_ray.direction, cos_theta_z, -sin_theta_z);
+// A uniform scale leaves directions and so solid angles as they are, and
+// scales distances.
+Vec3 TransformedHitable::random_direction(const Vec3 &origin, const Vec2 &u, float &distance) {
+    if (uniform_scale == 0.0 || !hitable) {
+        return Hitable::random_direction(origin, u, distance);
+    }
 
-    HitRecord record = hitable->intersect(transformed_ray);
+    Vec3 local_origin = world_to_object.transform_point(origin);
+    Vec3 direction = hitable->random_direction(local_origin, u, distance);
+    distance *= uniform_scale;
+    return Vec3::normalize(object_to_world.transform_vector(direction));
+}
 
-    if (record.did_hit) {
-        record.position = Vec3::rotate_z(record.position, cos_theta_z, sin_theta_z);
-        record.position = Vec3::rotate_y(record.position, cos_theta_y, sin_theta_y);
-        record.position = Vec3::rotate_x(record.position, cos_theta_x, sin_theta_x);
-        record.position = record.position + translation;
+float TransformedHitable::pdf_value(const Vec3 &origin, const Vec3 &direction) {
+    if (uniform_scale == 0.0 || !hitable) {
+        return 0.0;
+    }
 
-        record.normal = Vec3::rotate_z(record.normal, cos_theta_z, sin_theta_z);
-        record.normal = Vec3::rotate_y(record.normal, cos_theta_y, sin_theta_y);
-        record.normal = Vec3::rotate_x(record.normal, cos_theta_x, sin_theta_x);
+    Ray local_ray = to_local(Ray(origin, direction));
+    return hitable->pdf_value(local_ray.origin, Vec3::normalize(local_ray.direction));
+}
+
+AABB TransformedHitable::bounding_box() {
+    AABB result;
+
+    if (!hitable) {
+        return result;
     }
 
-    return record;
+    AABB box = hitable->bounding_box();
+
+    if (box.is_empty()) {
+        return result;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        Vec3 corner((i & 1) ? box.max.x : box.min.x,
+                    (i & 2) ? box.max.y : box.min.y,
+                    (i & 4) ? box.max.z : box.min.z);
+
+        result = AABB::merge(result, object_to_world.transform_point(corner));
+    }
+
+    return result;
+}
+
+template <class FloatN>
+static void transformed_intersect_packet(TransformedHitable *transformed, const RayPacket<FloatN> &packet, Hit *hits) {
+    if (!transformed->hitable) {
+        return;
+    }
+
+    Ray rays[FloatN::width];
+    Hit local_hits[FloatN::width];
+
+    for (int i = 0; i < FloatN::width; i++) {
+        rays[i] = transformed->to_local(packet.rays[i]);
+        local_hits[i].t = hits[i].t;
+    }
+
+    // Local rays keep t, so the closest hits found so far still bound the
+    // search in local space.
+    transformed->hitable->intersect_packet(RayPacket<FloatN>(rays), local_hits);
+
+    for (int i = 0; i < FloatN::width; i++) {
+        if (local_hits[i].hitable && transformed->push_instance(local_hits[i])) {
+            hits[i] = local_hits[i];
+        }
+    }
+}
+
+void TransformedHitable::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    transformed_intersect_packet(this, packet, hits);
 }
 
-HitRecord HitableList::intersect(const Ray &ray) {
-    HitRecord result;
-    result.did_hit = false;
-    result.t = FLT_MAX;
+void TransformedHitable::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    transformed_intersect_packet(this, packet, hits);
+}
+
+void PrimitiveArrays::add(Hitable *hitable) {
+    Hitable *primitive = hitable;
+    int primitive_frame = -1;
+
+    if (hitable->type == HITABLE_TRANSFORMED && static_cast<TransformedHitable*>(hitable)->hitable) {
+        primitive = static_cast<TransformedHitable*>(hitable)->hitable;
+    }
+
+    HitableType type = primitive->type;
+    if (type != HITABLE_SPHERE && type != HITABLE_XY_RECT && type != HITABLE_BOX) {
+        type = HITABLE_OTHER;
+    }
+    if (type != HITABLE_OTHER && primitive != hitable) {
+        primitive_frame = frames.size();
+        frames.push_back(static_cast<TransformedHitable*>(hitable)->world_to_object);
+    }
 
-    for (int i = 0; i < hitables.size(); i++) {
-        HitRecord temp_result = hitables[i]->intersect(ray);
+    Vec3 min, max;
 
-        if (temp_result.did_hit && temp_result.t < result.t) {
-            result = temp_result;
+    switch (type) {
+        case HITABLE_SPHERE: {
+            Sphere *sphere = static_cast<Sphere*>(primitive);
+            min = sphere->position;
+            max = Vec3(sphere->radius, 0.0, 0.0);
+            break;
         }
+        case HITABLE_XY_RECT: {
+            XYRect *rect = static_cast<XYRect*>(primitive);
+            min = Vec3(rect->min.x, rect->min.y, rect->max.z);
+            max = rect->max;
+            break;
+        }
+        case HITABLE_BOX: {
+            Box *box = static_cast<Box*>(primitive);
+            min = box->min;
+            max = box->max;
+            break;
+        }
+        default:
+            break;
+    }
+
+    items.push_back(hitable);
+    types.push_back(type);
+    x0.push_back(min.x);
+    y0.push_back(min.y);
+    z0.push_back(min.z);
+    x1.push_back(max.x);
+    y1.push_back(max.y);
+    z1.push_back(max.z);
+    frame.push_back(primitive_frame);
+}
+
+// The distance to primitive i along the ray, FLT_MAX where it is missed.
+// Local rays keep t, so distances found in the frame of a TransformedHitable
+// compare directly against world space ones.
+inline float PrimitiveArrays::primitive_t(int i, const Ray &ray) const {
+    Vec3 ro = ray.origin, rd = ray.direction;
+    if (frame[i] >= 0) {
+        Ray local_ray = frames[frame[i]].transform_ray(ray);
+        ro = local_ray.origin;
+        rd = local_ray.direction;
+    }
+
+    switch (types[i]) {
+        case HITABLE_SPHERE: {
+            Vec3 oc = ro - Vec3(x0[i], y0[i], z0[i]);
+            float a = Vec3::dot(rd, rd);
+            float b = 2.0 * Vec3::dot(rd, oc);
+            float c = Vec3::dot(oc, oc) - x1[i] * x1[i];
+            float det = b * b - 4 * a * c;
+
+            if (det < 0.0) {
+                return FLT_MAX;
+            }
+
+            float t = (-b - sqrt(det)) / (2.0 * a);
+            return t >= 0.0 ? t : FLT_MAX;
+        }
+        case HITABLE_XY_RECT: {
+            float t = ((z0[i] - ro.z) / rd.z) - 0.0001;
+            float x = ro.x + t * rd.x;
+            float y = ro.y + t * rd.y;
+
+            if (t >= 0.0 && x >= x0[i] && x <= x1[i] && y >= y0[i] && y <= y1[i]) {
+                return t;
+            }
+            return FLT_MAX;
+        }
+        case HITABLE_BOX: {
+            float ax = (x0[i] - ro.x) / rd.x, bx = (x1[i] - ro.x) / rd.x;
+            float ay = (y0[i] - ro.y) / rd.y, by = (y1[i] - ro.y) / rd.y;
+            float az = (z0[i] - ro.z) / rd.z, bz = (z1[i] - ro.z) / rd.z;
+
+            float t0 = fmaxf(fmaxf(fminf(ax, bx), fminf(ay, by)), fminf(az, bz));
+            float t1 = fminf(fminf(fmaxf(ax, bx), fmaxf(ay, by)), fmaxf(az, bz));
+
+            if (t0 >= 0.0 && t0 <= t1) {
+                return t0 - 0.0001;
+            }
+            return FLT_MAX;
+        }
+        default:
+            return FLT_MAX;
+    }
+}
+
+bool PrimitiveArrays::intersect(int start, int end, const Ray &ray, float t_max, Hit &hit) const {
+    float closest_t = t_max;
+    int closest = -1;
+    bool did_hit = false;
+
+    for (int i = start; i < end; i++) {
+        if (types[i] == HITABLE_OTHER) {
+            if (items[i]->intersect(ray, closest_t, hit)) {
+                closest_t = hit.t;
+                closest = -1;
+                did_hit = true;
+            }
+            continue;
+        }
+
+        float t = primitive_t(i, ray);
+        if (t < closest_t) {
+            closest_t = t;
+            closest = i;
+        }
+    }
+
+    if (closest < 0) {
+        return did_hit;
+    }
+
+    if (items[closest]->intersect(ray, did_hit ? hit.t : t_max, hit)) {
+        return true;
+    }
+
+    // The exact test disagreed at a silhouette, search the range the slow
+    // way rather than report a miss.
+    did_hit = false;
+    for (int i = start; i < end; i++) {
+        if (items[i]->intersect(ray, t_max, hit)) {
+            t_max = hit.t;
+            did_hit = true;
+        }
+    }
+
+    return did_hit;
+}
+
+bool PrimitiveArrays::occluded(int start, int end, const Ray &ray, float t_max) const {
+    for (int i = start; i < end; i++) {
+        if (types[i] == HITABLE_OTHER ? items[i]->occluded(ray, t_max) : primitive_t(i, ray) < t_max) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HitableList::intersect(const Ray &ray, float t_max, Hit &hit) {
+    return primitives.intersect(0, primitives.hitables().size(), ray, t_max, hit);
+}
+
+bool HitableList::occluded(const Ray &ray, float t_max) {
+    return primitives.occluded(0, primitives.hitables().size(), ray, t_max);
+}
+
+AABB HitableList::bounding_box() {
+    AABB result;
+
+    for (Hitable *hitable : primitives.hitables()) {
+        result = AABB::merge(result, hitable->bounding_box());
     }
 
     return result;
 }
+
+void HitableList::intersect_packet(const RayPacket4 &packet, Hit *hits) {
+    for (Hitable *hitable : primitives.hitables()) {
+        hitable->intersect_packet(packet, hits);
+    }
+}
+
+void HitableList::intersect_packet(const RayPacket8 &packet, Hit *hits) {
+    for (Hitable *hitable : primitives.hitables()) {
+        hitable->intersect_packet(packet, hits);
+    }
+}
@@ -3,82 +3,215 @@
 #include <vector>
 #include <cfloat>
 
+#include "aabb.h"
 #include "hit_record.h"
+#include "matrix.h"
+#include "ray_packet.h"
 #include "vec3.h"
 #include "ray.h"
 
+// Lets the primitives that PrimitiveArrays intersects inline, and the
+// hitables that contain others, be told apart without a dynamic_cast.
+enum HitableType {
+    HITABLE_OTHER,
+    HITABLE_SPHERE,
+    HITABLE_XY_RECT,
+    HITABLE_BOX,
+    HITABLE_TRANSFORMED,
+    HITABLE_BVH
+};
+
 class Hitable {
     public:
         Material *material;
+        HitableType type;
+
+        Hitable() {
+            this->material = nullptr;
+            this->type = HITABLE_OTHER;
+        };
 
-        virtual HitRecord intersect(const Ray &ray) = 0;
+        virtual ~Hitable() { };
+
+        // Looks for a hit closer than t_max and fills in only what is needed
+        // to tell hits apart, leaving normals, texture coordinates and
+        // materials to finalize().
+        virtual bool intersect(const Ray &ray, float t_max, Hit &hit) = 0;
+
+        // Bounds everything intersect() can hit, in the space of the rays
+        // it is given. Empty for hitables with nothing in them.
+        virtual AABB bounding_box() = 0;
+
+        // Reports whether anything lies along the ray closer than t_max,
+        // stopping at the first hit found rather than the closest one.
+        virtual bool occluded(const Ray &ray, float t_max);
+
+        // Computes the surface interaction of a hit this primitive returned
+        // from intersect(), with the ray in the primitive's own space.
+        // Aggregates never appear in Hit::hitable and keep the default.
+        virtual void finalize(const Ray &ray, const Hit &hit, HitRecord &record);
+
+        // Light sampling, see "Ray Tracing: The Rest of Your Life". Picks a
+        // direction from origin towards a point on the surface and reports
+        // the distance to it. pdf_value() is the solid angle density of
+        // picking direction, zero for directions that miss and for hitables
+        // that cannot be sampled.
+        virtual Vec3 random_direction(const Vec3 &origin, const Vec2 &u, float &distance);
+        virtual float pdf_value(const Vec3 &origin, const Vec3 &direction);
+
+        // Updates hits[i] wherever lane i hits closer than hits[i].t. The
+        // default traces every lane as a single ray.
+        virtual void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        virtual void intersect_packet(const RayPacket8 &packet, Hit *hits);
+
+        // Sets blocked[i] wherever lane i is occluded closer than t_max[i],
+        // leaving lanes that are already blocked alone. The default tests
+        // every lane as a single ray.
+        virtual void occluded_packet(const RayPacket4 &packet, const float *t_max, bool *blocked);
+        virtual void occluded_packet(const RayPacket8 &packet, const float *t_max, bool *blocked);
+
+        // Finds and finalizes the closest hit.
+        HitRecord closest_hit(const Ray &ray);
 };
 
+// Computes the HitRecord of a hit in world space, passing the ray down
+// through and the result back up through the hit's instances.
+HitRecord finalize_hit(const Ray &ray, const Hit &hit);
+
 class Sphere : public Hitable {
     public:
         Vec3 position;
         float radius;
 
         Sphere(const Vec3 &position, float radius) {
+            this->type = HITABLE_SPHERE;
             this->position = position;
             this->radius = radius;
         }
 
-        HitRecord intersect(const Ray &ray);
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        void finalize(const Ray &ray, const Hit &hit, HitRecord &record);
+        Vec3 random_direction(const Vec3 &origin, const Vec2 &u, float &distance);
+        float pdf_value(const Vec3 &origin, const Vec3 &direction);
+        void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        void intersect_packet(const RayPacket8 &packet, Hit *hits);
 };
 
 class XYRect : public Hitable {
     public:
         Vec3 min, max;
 
-        XYRect() { };
+        XYRect() {
+            this->type = HITABLE_XY_RECT;
+        };
 
         XYRect(const Vec3 &min, const Vec3 &max) {
+            this->type = HITABLE_XY_RECT;
             this->min = min;
             this->max = max;
         };
 
-        HitRecord intersect(const Ray &ray);
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        void finalize(const Ray &ray, const Hit &hit, HitRecord &record);
+        Vec3 random_direction(const Vec3 &origin, const Vec2 &u, float &distance);
+        float pdf_value(const Vec3 &origin, const Vec3 &direction);
+        void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        void intersect_packet(const RayPacket8 &packet, Hit *hits);
 };
 
+// An instance of a hitable placed by object_to_world = T Rx Ry Rz S, which
+// scales it, then rotates it about the fixed z axis, then y, then x, and
+// translates it last. The matrices are worked out once, and any number of
+// instances can share one hitable, whose BVH then serves as the bottom level
+// under the scene's. Rays are carried into the hitable's space without
+// normalizing their directions, so t means the same on both sides.
 class TransformedHitable : public Hitable {
-    private:
-        float cos_theta_x, sin_theta_x;
-        float cos_theta_y, sin_theta_y;
-        float cos_theta_z, sin_theta_z;
-
     public:
         Hitable *hitable;
         Vec3 translation, rotation, scale;
-
-        TransformedHitable() { 
-            this->hitable = nullptr; 
-        };
+        Matrix3x4 world_to_object, object_to_world, normal_to_world;
+        // The scale when it is the same along every axis, zero otherwise.
+        // Lights can only be sampled through uniformly scaled transforms.
+        float uniform_scale;
 
         TransformedHitable(Hitable *hitable, const Vec3 &translation, const Vec3 &rotation, const Vec3 &scale) {
+            this->type = HITABLE_TRANSFORMED;
             this->hitable = hitable;
             this->translation = translation;
             this->rotation = rotation;
             this->scale = scale;
 
-            cos_theta_x = cos(rotation.x);
-            sin_theta_x = sin(rotation.x);
+            object_to_world = Matrix3x4::translate(translation) * Matrix3x4::rotate_x(rotation.x) *
+                              Matrix3x4::rotate_y(rotation.y) * Matrix3x4::rotate_z(rotation.z) * Matrix3x4::scale(scale);
+            world_to_object = object_to_world.inverse();
+            normal_to_world = object_to_world.normal_matrix();
 
-            cos_theta_y = cos(rotation.y);
-            sin_theta_y = sin(rotation.y);
+            bool is_uniform = scale.x == scale.y && scale.y == scale.z && scale.x > 0.0;
+            uniform_scale = is_uniform ? scale.x : 0.0;
+        };
 
-            cos_theta_z = cos(rotation.z);
-            sin_theta_z = sin(rotation.z);
+        Ray to_local(const Ray &ray) const;
+        void to_world(HitRecord &record) const;
+        bool push_instance(Hit &hit) const;
+
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        bool occluded(const Ray &ray, float t_max);
+        Vec3 random_direction(const Vec3 &origin, const Vec2 &u, float &distance);
+        float pdf_value(const Vec3 &origin, const Vec3 &direction);
+        void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        void intersect_packet(const RayPacket8 &packet, Hit *hits);
+};
+
+// Hitables kept in the order they were added, along with a structure of
+// arrays for the spheres, rects and boxes among them, bare or wrapped in a
+// single TransformedHitable. Those are tested inline by a loop that only
+// tracks the closest t, and the Hit is filled in once, by the closest one.
+// Any other hitable is intersected through its virtual intersect(). Spheres
+// keep their center in x0, y0, z0 and radius in x1, rects their corners in
+// x0, y0, x1, y1 and their z in z0, and boxes their corners in all six.
+class PrimitiveArrays {
+    private:
+        std::vector<Hitable*> items;
+        std::vector<HitableType> types;
+        std::vector<float> x0, y0, z0, x1, y1, z1;
+        std::vector<int> frame;
+        std::vector<Matrix3x4> frames;
+
+        float primitive_t(int i, const Ray &ray) const;
+
+    public:
+        void add(Hitable *hitable);
+
+        const std::vector<Hitable*> &hitables() const {
+            return items;
         };
 
-        HitRecord intersect(const Ray &ray);
+        // Intersect the hitables from start up to end.
+        bool intersect(int start, int end, const Ray &ray, float t_max, Hit &hit) const;
+        bool occluded(int start, int end, const Ray &ray, float t_max) const;
 };
 
 class HitableList : public Hitable {
+    private:
+        PrimitiveArrays primitives;
+
     public:
-        std::vector<Hitable*> hitables;
+        void add(Hitable *hitable) {
+            primitives.add(hitable);
+        };
+
+        const std::vector<Hitable*> &hitables() const {
+            return primitives.hitables();
+        };
 
-        HitRecord intersect(const Ray &ray);
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        bool occluded(const Ray &ray, float t_max);
+        void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        void intersect_packet(const RayPacket8 &packet, Hit *hits);
 };
 
 class Box : public Hitable {
@@ -86,9 +219,14 @@ class Box : public Hitable {
         Vec3 min, max;
 
         Box(const Vec3 &min, const Vec3 &max) {
+            this->type = HITABLE_BOX;
             this->min = min;
             this->max = max;
         };
 
-        HitRecord intersect(const Ray &ray);
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        void finalize(const Ray &ray, const Hit &hit, HitRecord &record);
+        void intersect_packet(const RayPacket4 &packet, Hit *hits);
+        void intersect_packet(const RayPacket8 &packet, Hit *hits);
 };
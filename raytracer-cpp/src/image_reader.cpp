@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "image_reader.h"
+#include "image_writer.h"
+
+static bool read_file(const char *path, std::vector<unsigned char> &data) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open '%s'\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data.resize(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(&data[0], 1, size, file) == (size_t) size;
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "Could not read '%s'\n", path);
+    }
+
+    return ok;
+}
+
+bool read_image(const char *path, int &width, int &height, std::vector<float> &rgb) {
+    ImageFormat format;
+    if (!image_format_from_path(path, format) || !is_hdr_format(format)) {
+        fprintf(stderr, "Can only read back .pfm and .exr images, not '%s'\n", path);
+        return false;
+    }
+
+    if (format == IMAGE_FORMAT_PFM) {
+        return read_pfm(path, width, height, rgb);
+    }
+
+    return read_exr(path, width, height, rgb);
+}
+
+bool read_pfm(const char *path, int &width, int &height, std::vector<float> &rgb) {
+    std::vector<unsigned char> data;
+    if (!read_file(path, data)) {
+        return false;
+    }
+
+    data.push_back(0);
+    char magic[3];
+    float scale;
+    int header_size = 0;
+
+    if (sscanf((const char *) &data[0], "%2s %d %d %f%n", magic, &width, &height, &scale, &header_size) != 4 ||
+        strcmp(magic, "PF") != 0 || scale >= 0.0 || width <= 0 || height <= 0) {
+        fprintf(stderr, "'%s' is not a little endian RGB PFM\n", path);
+        return false;
+    }
+
+    // A single whitespace character separates the header from the data.
+    header_size++;
+    size_t row_size = 3 * (size_t) width * sizeof(float);
+
+    if (data.size() - 1 < header_size + row_size * height) {
+        fprintf(stderr, "'%s' is truncated\n", path);
+        return false;
+    }
+
+    rgb.resize(3 * (size_t) width * height);
+    for (int y = 0; y < height; y++) {
+        memcpy(&rgb[3 * (size_t) width * y], &data[header_size + row_size * (height - 1 - y)], row_size);
+    }
+
+    return true;
+}
+
+static uint32_t get_u32_le(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+bool read_exr(const char *path, int &width, int &height, std::vector<float> &rgb) {
+    std::vector<unsigned char> data;
+    if (!read_file(path, data)) {
+        return false;
+    }
+
+    if (data.size() < 8 || get_u32_le(&data[0]) != 20000630 || (data[4] != 2) || data[5] != 0) {
+        fprintf(stderr, "'%s' is not a single part scanline EXR\n", path);
+        return false;
+    }
+
+    std::vector<std::string> channel_names;
+    int x_min = 0, y_min = 0, x_max = -1, y_max = -1;
+    bool supported = true;
+    size_t i = 8;
+
+    // Attributes are a name, a type, a size and the value, up to an empty name.
+    while (i < data.size() && data[i] != 0) {
+        const char *name = (const char *) &data[i];
+        size_t type = i + strnlen(name, data.size() - i) + 1;
+        size_t size = type + strnlen((const char *) &data[type], data.size() - type) + 1;
+        if (size + 4 > data.size()) {
+            break;
+        }
+
+        size_t value = size + 4;
+        uint32_t value_size = get_u32_le(&data[size]);
+        if (value + value_size > data.size()) {
+            break;
+        }
+
+        if (strcmp(name, "channels") == 0) {
+            size_t c = value;
+            while (c < value + value_size && data[c] != 0) {
+                std::string channel((const char *) &data[c]);
+                c += channel.size() + 1;
+                supported = supported && get_u32_le(&data[c]) == 2;
+                channel_names.push_back(channel);
+                c += 16;
+            }
+        }
+        else if (strcmp(name, "compression") == 0) {
+            supported = supported && data[value] == 0;
+        }
+        else if (strcmp(name, "dataWindow") == 0) {
+            x_min = get_u32_le(&data[value]);
+            y_min = get_u32_le(&data[value + 4]);
+            x_max = get_u32_le(&data[value + 8]);
+            y_max = get_u32_le(&data[value + 12]);
+        }
+
+        i = value + value_size;
+    }
+    i++;
+
+    width = x_max - x_min + 1;
+    height = y_max - y_min + 1;
+
+    int channel_index[3] = { -1, -1, -1 };
+    for (int c = 0; c < (int) channel_names.size(); c++) {
+        if (channel_names[c] == "R") {
+            channel_index[0] = c;
+        }
+        else if (channel_names[c] == "G") {
+            channel_index[1] = c;
+        }
+        else if (channel_names[c] == "B") {
+            channel_index[2] = c;
+        }
+    }
+
+    if (!supported || width <= 0 || height <= 0 || channel_index[0] < 0 || channel_index[1] < 0 || channel_index[2] < 0) {
+        fprintf(stderr, "'%s' is not an uncompressed float RGB EXR\n", path);
+        return false;
+    }
+
+    size_t line_size = channel_names.size() * (size_t) width * sizeof(float);
+    rgb.resize(3 * (size_t) width * height);
+
+    for (int y = 0; y < height; y++) {
+        if (i + 8 * (size_t) y + 8 > data.size()) {
+            fprintf(stderr, "'%s' is truncated\n", path);
+            return false;
+        }
+
+        size_t offset = get_u32_le(&data[i + 8 * y]) | ((uint64_t) get_u32_le(&data[i + 8 * y + 4]) << 32);
+        if (offset + 8 + line_size > data.size()) {
+            fprintf(stderr, "'%s' is truncated\n", path);
+            return false;
+        }
+
+        int line = (int) get_u32_le(&data[offset]) - y_min;
+        if (line < 0 || line >= height) {
+            fprintf(stderr, "'%s' has a scanline outside its data window\n", path);
+            return false;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            const unsigned char *channel = &data[offset + 8 + channel_index[c] * (size_t) width * sizeof(float)];
+
+            for (int x = 0; x < width; x++) {
+                uint32_t bits = get_u32_le(&channel[4 * x]);
+                memcpy(&rgb[3 * ((size_t) line * width + x) + c], &bits, sizeof(float));
+            }
+        }
+    }
+
+    return true;
+}
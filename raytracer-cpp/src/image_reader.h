@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vector>
+
+// Reads the HDR images write_image() produces back into width * height
+// linear RGB triples, top row first, so renders can be tonemapped again
+// without rendering them again. Only uncompressed EXR files with 32-bit
+// float channels are supported.
+bool read_image(const char *path, int &width, int &height, std::vector<float> &rgb);
+
+bool read_pfm(const char *path, int &width, int &height, std::vector<float> &rgb);
+bool read_exr(const char *path, int &width, int &height, std::vector<float> &rgb);
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <vector>
+#include <zlib.h>
+
+#include "image_writer.h"
+
+static const char *format_names[] = { "ppm", "png", "pfm", "exr" };
+
+bool parse_image_format(const char *name, ImageFormat &format) {
+    for (int i = 0; i < 4; i++) {
+        if (strcasecmp(name, format_names[i]) == 0) {
+            format = (ImageFormat) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool image_format_from_path(const char *path, ImageFormat &format) {
+    const char *extension = strrchr(path, '.');
+    return extension && parse_image_format(extension + 1, format);
+}
+
+const char *image_format_name(ImageFormat format) {
+    return format_names[format];
+}
+
+bool is_hdr_format(ImageFormat format) {
+    return format == IMAGE_FORMAT_PFM || format == IMAGE_FORMAT_EXR;
+}
+
+bool write_image(const char *path, ImageFormat format, int width, int height, const float *rgb) {
+    if (format == IMAGE_FORMAT_PFM) {
+        return write_pfm(path, width, height, rgb);
+    }
+    else if (format == IMAGE_FORMAT_EXR) {
+        return write_exr(path, width, height, rgb);
+    }
+
+    std::vector<unsigned char> bytes(3 * (size_t) width * height);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        // Written so that NaN ends up as 0.
+        float v = rgb[i] > 0.0 ? (rgb[i] < 1.0 ? rgb[i] : 1.0) : 0.0;
+        bytes[i] = (unsigned char) (v * 255);
+    }
+
+    if (format == IMAGE_FORMAT_PNG) {
+        return write_png(path, width, height, &bytes[0]);
+    }
+
+    return write_ppm(path, width, height, &bytes[0]);
+}
+
+static bool write_file(const char *path, const char *header, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open '%s' for writing\n", path);
+        return false;
+    }
+
+    bool ok = fputs(header, file) >= 0 && fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok) {
+        fprintf(stderr, "Could not write '%s'\n", path);
+    }
+
+    return ok;
+}
+
+bool write_ppm(const char *path, int width, int height, const unsigned char *rgb) {
+    char header[64];
+    snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+    return write_file(path, header, rgb, 3 * (size_t) width * height);
+}
+
+// Rows go bottom to top, and the negative scale marks the floats as little
+// endian, which is what every platform we build on uses.
+bool write_pfm(const char *path, int width, int height, const float *rgb) {
+    char header[64];
+    snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", width, height);
+
+    std::vector<float> rows(3 * (size_t) width * height);
+    for (int y = 0; y < height; y++) {
+        memcpy(&rows[3 * (size_t) width * (height - 1 - y)], &rgb[3 * (size_t) width * y], 3 * width * sizeof(float));
+    }
+
+    return write_file(path, header, &rows[0], rows.size() * sizeof(float));
+}
+
+static void put_bytes(std::vector<unsigned char> &out, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static void put_u32_le(std::vector<unsigned char> &out, uint32_t v) {
+    unsigned char bytes[4] = { (unsigned char) v, (unsigned char) (v >> 8), (unsigned char) (v >> 16), (unsigned char) (v >> 24) };
+    put_bytes(out, bytes, 4);
+}
+
+static void put_u64_le(std::vector<unsigned char> &out, uint64_t v) {
+    put_u32_le(out, (uint32_t) v);
+    put_u32_le(out, (uint32_t) (v >> 32));
+}
+
+static void put_float_le(std::vector<unsigned char> &out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    put_u32_le(out, bits);
+}
+
+static void put_u32_be(std::vector<unsigned char> &out, uint32_t v) {
+    unsigned char bytes[4] = { (unsigned char) (v >> 24), (unsigned char) (v >> 16), (unsigned char) (v >> 8), (unsigned char) v };
+    put_bytes(out, bytes, 4);
+}
+
+static void put_exr_attribute(std::vector<unsigned char> &out, const char *name, const char *type, const std::vector<unsigned char> &value) {
+    put_bytes(out, name, strlen(name) + 1);
+    put_bytes(out, type, strlen(type) + 1);
+    put_u32_le(out, value.size());
+    put_bytes(out, &value[0], value.size());
+}
+
+// Uncompressed single part scanline OpenEXR with 32-bit float channels.
+bool write_exr(const char *path, int width, int height, const float *rgb) {
+    std::vector<unsigned char> out, value;
+
+    put_u32_le(out, 20000630);
+    put_u32_le(out, 2);
+
+    // Channels are stored in alphabetical order.
+    const char *channel_names[] = { "B", "G", "R" };
+    for (int c = 0; c < 3; c++) {
+        put_bytes(value, channel_names[c], 2);
+        put_u32_le(value, 2);
+        put_u32_le(value, 0);
+        put_u32_le(value, 1);
+        put_u32_le(value, 1);
+    }
+    value.push_back(0);
+    put_exr_attribute(out, "channels", "chlist", value);
+
+    put_exr_attribute(out, "compression", "compression", std::vector<unsigned char>(1, 0));
+
+    value.clear();
+    put_u32_le(value, 0);
+    put_u32_le(value, 0);
+    put_u32_le(value, width - 1);
+    put_u32_le(value, height - 1);
+    put_exr_attribute(out, "dataWindow", "box2i", value);
+    put_exr_attribute(out, "displayWindow", "box2i", value);
+
+    put_exr_attribute(out, "lineOrder", "lineOrder", std::vector<unsigned char>(1, 0));
+
+    value.clear();
+    put_float_le(value, 1.0);
+    put_exr_attribute(out, "pixelAspectRatio", "float", value);
+    put_exr_attribute(out, "screenWindowWidth", "float", value);
+
+    value.clear();
+    put_float_le(value, 0.0);
+    put_float_le(value, 0.0);
+    put_exr_attribute(out, "screenWindowCenter", "v2f", value);
+
+    out.push_back(0);
+
+    uint32_t line_size = 3 * width * sizeof(float);
+    uint64_t offset = out.size() + 8 * (uint64_t) height;
+    out.reserve(offset + (uint64_t) height * (8 + line_size));
+    for (int y = 0; y < height; y++) {
+        put_u64_le(out, offset + (uint64_t) y * (8 + line_size));
+    }
+
+    for (int y = 0; y < height; y++) {
+        put_u32_le(out, y);
+        put_u32_le(out, line_size);
+
+        for (int c = 2; c >= 0; c--) {
+            for (int x = 0; x < width; x++) {
+                put_float_le(out, rgb[3 * ((size_t) y * width + x) + c]);
+            }
+        }
+    }
+
+    return write_file(path, "", &out[0], out.size());
+}
+
+static inline int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+// Each filter predicts a byte from the one to its left (a), above (b) and
+// above left (c), with the left ones zero for the first pixel of a row.
+template <int filter>
+static inline unsigned char png_filter_byte(int x, int a, int b, int c) {
+    if (filter == 1) {
+        return x - a;
+    }
+    else if (filter == 2) {
+        return x - b;
+    }
+    else if (filter == 3) {
+        return x - ((a + b) >> 1);
+    }
+    else if (filter == 4) {
+        return x - paeth(a, b, c);
+    }
+    return x;
+}
+
+// Returns the sum of absolute values of the filtered row, storing it in
+// dest unless that is null. The first pixel is split off so the main loop
+// has no branches and vectorizes.
+template <int filter>
+static long png_filter_row(const unsigned char *row, const unsigned char *up, int stride, unsigned char *dest) {
+    long cost = 0;
+
+    for (int i = 0; i < 3 && i < stride; i++) {
+        unsigned char v = png_filter_byte<filter>(row[i], 0, up[i], 0);
+        cost += abs((signed char) v);
+        if (dest) {
+            dest[i] = v;
+        }
+    }
+
+    if (dest) {
+        for (int i = 3; i < stride; i++) {
+            dest[i] = png_filter_byte<filter>(row[i], row[i - 3], up[i], up[i - 3]);
+        }
+        for (int i = 3; i < stride; i++) {
+            cost += abs((signed char) dest[i]);
+        }
+    }
+    else {
+        for (int i = 3; i < stride; i++) {
+            cost += abs((signed char) png_filter_byte<filter>(row[i], row[i - 3], up[i], up[i - 3]));
+        }
+    }
+
+    return cost;
+}
+
+static long png_filter_row(int filter, const unsigned char *row, const unsigned char *up, int stride, unsigned char *dest) {
+    switch (filter) {
+        case 1: return png_filter_row<1>(row, up, stride, dest);
+        case 2: return png_filter_row<2>(row, up, stride, dest);
+        case 3: return png_filter_row<3>(row, up, stride, dest);
+        case 4: return png_filter_row<4>(row, up, stride, dest);
+        default: return png_filter_row<0>(row, up, stride, dest);
+    }
+}
+
+static void put_png_chunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data) {
+    put_u32_be(out, data.size());
+    size_t start = out.size();
+    put_bytes(out, type, 4);
+    if (!data.empty()) {
+        put_bytes(out, &data[0], data.size());
+    }
+    put_u32_be(out, crc32(0, &out[start], out.size() - start));
+}
+
+// Every row gets whichever of the five PNG filters leaves the smallest sum
+// of absolute differences, the heuristic the PNG specification suggests,
+// and zlib deflates the filtered rows.
+bool write_png(const char *path, int width, int height, const unsigned char *rgb) {
+    int stride = 3 * width;
+    std::vector<unsigned char> filtered((size_t) (stride + 1) * height);
+    std::vector<unsigned char> zero_row(stride, 0);
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char *row = &rgb[(size_t) stride * y];
+        const unsigned char *up = y > 0 ? row - stride : &zero_row[0];
+        unsigned char *dest = &filtered[(size_t) (stride + 1) * y];
+        int best_filter = 0;
+        long best_cost = -1;
+
+        for (int filter = 0; filter < 5; filter++) {
+            long cost = png_filter_row(filter, row, up, stride, nullptr);
+
+            if (best_cost < 0 || cost < best_cost) {
+                best_cost = cost;
+                best_filter = filter;
+            }
+        }
+
+        dest[0] = best_filter;
+        png_filter_row(best_filter, row, up, stride, dest + 1);
+    }
+
+    std::vector<unsigned char> out, chunk;
+    const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    put_bytes(out, signature, 8);
+
+    put_u32_be(chunk, width);
+    put_u32_be(chunk, height);
+    chunk.push_back(8);
+    chunk.push_back(2);
+    chunk.push_back(0);
+    chunk.push_back(0);
+    chunk.push_back(0);
+    put_png_chunk(out, "IHDR", chunk);
+
+    uLongf compressed_size = compressBound(filtered.size());
+    chunk.resize(compressed_size);
+    if (compress2(&chunk[0], &compressed_size, &filtered[0], filtered.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Could not compress '%s'\n", path);
+        return false;
+    }
+    chunk.resize(compressed_size);
+    put_png_chunk(out, "IDAT", chunk);
+
+    put_png_chunk(out, "IEND", std::vector<unsigned char>());
+
+    return write_file(path, "", &out[0], out.size());
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+enum ImageFormat {
+    IMAGE_FORMAT_PPM,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_PFM,
+    IMAGE_FORMAT_EXR
+};
+
+// Looks the format up by name, or by the extension of a path, returning
+// false for names it does not know.
+bool parse_image_format(const char *name, ImageFormat &format);
+bool image_format_from_path(const char *path, ImageFormat &format);
+const char *image_format_name(ImageFormat format);
+
+// PFM and EXR keep the full float range.
+bool is_hdr_format(ImageFormat format);
+
+// Images are width * height RGB triples, top row first. The 8-bit formats
+// are quantized from rgb clamped to [0, 1] as is, so any display transform
+// has to be applied beforehand.
+bool write_image(const char *path, ImageFormat format, int width, int height, const float *rgb);
+
+bool write_ppm(const char *path, int width, int height, const unsigned char *rgb);
+bool write_png(const char *path, int width, int height, const unsigned char *rgb);
+bool write_pfm(const char *path, int width, int height, const float *rgb);
+bool write_exr(const char *path, int width, int height, const float *rgb);
@@ -0,0 +1,688 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "integrator.h"
+
+static thread_local long long num_rays = 0;
+static thread_local long long num_path_segments = 0;
+
+// Power heuristic with an exponent of two, from Veach's thesis.
+static float power_heuristic(float pdf, float other_pdf) {
+    return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+}
+
+// Next event estimation: connects the hit to a point on a randomly picked
+// light, weighted against the material picking the same direction. The
+// shadow ray is left to the caller to trace, and stays inactive where the
+// light cannot contribute.
+void Integrator::sample_direct_light(const Ray &ray, const HitRecord &hit_record, const Vec3 &albedo, Sampler &sampler, ShadowRay &shadow) {
+    float u_light = sampler.next_1d();
+    Vec2 u = sampler.next_2d();
+
+    if (lights->lights.empty()) {
+        return;
+    }
+
+    Vec3 direction;
+    float distance;
+    Material *light_material = lights->sample(hit_record.position, u_light, u, direction, distance);
+    if (!light_material) {
+        return;
+    }
+
+    float light_pdf = lights->pdf_value(hit_record.position, direction, distance);
+    float scatter_pdf = hit_record.material->pdf(ray, direction, hit_record.normal);
+
+    if (light_pdf <= 0.0 || scatter_pdf <= 0.0) {
+        return;
+    }
+
+    Vec3 f = hit_record.material->eval(albedo, ray, direction, hit_record.normal);
+    Vec3 emitted_light = shading->evaluate(light_material->albedo_node, Vec2(0.0, 0.0), hit_record.position + distance * direction);
+    float weight = power_heuristic(light_pdf, scatter_pdf);
+
+    shadow.active = true;
+    shadow.ray = Ray(hit_record.position, direction);
+    shadow.distance = 0.999 * distance;
+    shadow.contribution = (weight / light_pdf) * (f * emitted_light);
+}
+
+bool Integrator::unoccluded(const ShadowRay &shadow) {
+    num_rays++;
+    return !scene->occluded(shadow.ray, shadow.distance);
+}
+
+// Finds how far the hit moves on its surface from one pixel to the next.
+// Camera rays intersect their differential rays with the tangent plane at
+// the hit. Later rays, whose differentials are not tracked, use a cone of
+// pixel_spread around the path instead.
+void Integrator::find_texture_footprint(HitRecord &hit_record, const Ray &ray, const RayDifferential *differential, float path_length) {
+    if (Vec3::dot(hit_record.dpdu, hit_record.dpdu) == 0.0 && Vec3::dot(hit_record.dpdv, hit_record.dpdv) == 0.0) {
+        return;
+    }
+
+    const Vec3 &n = hit_record.normal;
+
+    if (differential) {
+        Vec3 dx_direction = ray.direction + differential->dx_direction;
+        Vec3 dy_direction = ray.direction + differential->dy_direction;
+        float dx_cos = Vec3::dot(n, dx_direction), dy_cos = Vec3::dot(n, dy_direction);
+
+        if (dx_cos != 0.0 && dy_cos != 0.0) {
+            float distance = Vec3::dot(n, hit_record.position - ray.origin);
+            Vec3 dpdx = ray.origin + (distance / dx_cos) * dx_direction - hit_record.position;
+            Vec3 dpdy = ray.origin + (distance / dy_cos) * dy_direction - hit_record.position;
+            hit_record.set_texture_footprint(dpdx, dpdy);
+            return;
+        }
+    }
+
+    Vec3 tangent, bitangent;
+    Vec3::orthonormal_basis(n, tangent, bitangent);
+    float width = differential_scale * pixel_spread * path_length;
+    hit_record.set_texture_footprint(width * tangent, width * bitangent);
+}
+
+// Where the texture of a hit's material is looked up. Lights use texture
+// coordinate zero all over, since light sampling finds points on them
+// without one.
+static TextureCoord shading_coord(const HitRecord &hit_record) {
+    return hit_record.material->is_emissive() ? TextureCoord(Vec2(0.0, 0.0)) : hit_record.texture_coord;
+}
+
+// One bounce of a path at a hit whose material's texture gave albedo: adds
+// what the hit emits, samples a light into shadow and scatters the path on,
+// playing Russian roulette once it is rr_depth bounces long. Returns false
+// where the path ends, which leaves the shadow ray still to be traced.
+bool Integrator::shade_hit(PathState &path, int depth, const HitRecord &hit_record, const Vec3 &albedo, Sampler &sampler, ShadowRay &shadow) {
+    const Material *material = hit_record.material;
+    shadow.active = false;
+
+    if (material->is_emissive()) {
+        float weight = 1.0;
+
+        // Emitters the camera sees or that are reached through a specular
+        // bounce cannot have been found by light sampling.
+        if (light_sampling && !path.specular_bounce) {
+            weight = power_heuristic(path.scatter_pdf, lights->pdf_value(path.ray.origin, path.ray.direction, hit_record.t));
+        }
+
+        path.color = path.color + weight * (path.throughput * albedo);
+    }
+
+    ScatterResult scatter_result = material->scatter(albedo, path.ray, hit_record.position, hit_record.normal, sampler);
+
+    if (!scatter_result.did_scatter) {
+        return false;
+    }
+
+    if (light_sampling && !scatter_result.is_specular) {
+        sample_direct_light(path.ray, hit_record, albedo, sampler, shadow);
+        shadow.contribution = path.throughput * shadow.contribution;
+    }
+
+    path.throughput = path.throughput * scatter_result.color;
+    path.scatter_pdf = scatter_result.pdf;
+    path.specular_bounce = scatter_result.is_specular;
+    path.ray = scatter_result.ray;
+
+    const Vec3 &throughput = path.throughput;
+    if (throughput.x <= 0.0 && throughput.y <= 0.0 && throughput.z <= 0.0) {
+        return false;
+    }
+
+    // Russian roulette: once rr_depth bounces are done, paths continue
+    // with a probability that follows their largest throughput channel,
+    // and survivors are reweighted to keep the estimate unbiased.
+    if (depth + 1 >= rr_depth) {
+        float survival = fminf(0.95, fmaxf(throughput.x, fmaxf(throughput.y, throughput.z)));
+
+        if (sampler.next_1d() >= survival) {
+            return false;
+        }
+
+        path.throughput = (1.0 / survival) * throughput;
+    }
+
+    return true;
+}
+
+// Follows a path whose first hit has already been found and shaded, the
+// texture of its material looked up as first_albedo, which lets camera
+// rays be traced and shaded in packets.
+Vec3 Integrator::color_path(const Ray &ray, const HitRecord &first_hit, const Vec3 &first_albedo, Sampler &sampler) {
+    PathState path(ray);
+    HitRecord hit_record = first_hit;
+    Vec3 albedo = first_albedo;
+
+    for (int depth = 0; depth < max_depth; depth++) {
+        num_path_segments++;
+
+        if (depth > 0) {
+            hit_record = scene->closest_hit(path.ray);
+            num_rays++;
+        }
+
+        if (!hit_record.did_hit) {
+            break;
+        }
+
+        path.path_length += hit_record.t * Vec3::length(path.ray.direction);
+
+        if (depth > 0) {
+            find_texture_footprint(hit_record, path.ray, nullptr, path.path_length);
+            albedo = shading->evaluate(hit_record.material->albedo_node, shading_coord(hit_record), hit_record.position);
+        }
+
+        ShadowRay shadow;
+        bool alive = shade_hit(path, depth, hit_record, albedo, sampler, shadow);
+
+        if (shadow.active && unoccluded(shadow)) {
+            path.color = path.color + shadow.contribution;
+        }
+        if (!alive) {
+            break;
+        }
+    }
+
+    return path.color;
+}
+
+Vec3 Integrator::color_ray(const Ray &ray, const RayDifferential &differential, Sampler &sampler) {
+    HitRecord hit_record = scene->closest_hit(ray);
+    Vec3 albedo;
+    num_rays++;
+
+    if (hit_record.did_hit) {
+        find_texture_footprint(hit_record, ray, &differential, hit_record.t * Vec3::length(ray.direction));
+        albedo = shading->evaluate(hit_record.material->albedo_node, shading_coord(hit_record), hit_record.position);
+    }
+
+    return color_path(ray, hit_record, albedo, sampler);
+}
+
+// Pixel (x, y) is centered on (x, y) on the film, and the sample is offset
+// from there as the filter is distributed.
+Ray Integrator::camera_ray(Camera &camera, Sampler &sampler, int x, int y, int sample_index, float &weight, RayDifferential &differential) {
+    sampler.start_pixel_sample(x, y, sample_index);
+    Vec2 offset = filter->sample(sampler.next_2d(), weight);
+
+    float u = (x + offset.x) / width;
+    float v = 1.0 - ((y + offset.y) / height);
+
+    return camera.create_ray(u, v, differential_scale / width, differential_scale / height, differential);
+}
+
+void Integrator::render_tile(const Tile &tile, Camera &camera, Sampler &sampler, int num_samples, Film &film) {
+    for (int i = tile.y0; i < tile.y1; i++) {
+        for (int j = tile.x0; j < tile.x1; j++) {
+            for (int k = 0; k < num_samples; k++) {
+                float weight;
+                RayDifferential differential;
+                Ray ray = camera_ray(camera, sampler, j, i, k, weight, differential);
+                film.add_sample(j, i, color_ray(ray, differential, sampler), weight);
+            }
+        }
+    }
+}
+
+// Lets a path continue its pixel sample on a sampler that other paths have
+// used since, by restarting the sample and skipping the dimensions the path
+// has already used.
+static void resume_pixel_sample(Sampler &sampler, int x, int y, int sample_index, int dimension) {
+    sampler.start_pixel_sample(x, y, sample_index);
+    sampler.skip_to_dimension(dimension);
+}
+
+// Traces camera rays for blocks of (width / 2) x 2 pixels as one packet,
+// shades their first hits as one batch and continues every path on its own
+// from there. The lanes resume their pixel samples to continue, so the
+// result matches render_tile().
+template <class FloatN>
+void Integrator::render_tile_packets(const Tile &tile, Camera &camera, Sampler &sampler, int num_samples, Film &film) {
+    const int lanes = FloatN::width;
+    const int block_width = lanes / 2;
+
+    for (int by = tile.y0; by < tile.y1; by += 2) {
+        for (int bx = tile.x0; bx < tile.x1; bx += block_width) {
+            int xs[lanes], ys[lanes];
+            bool valid[lanes];
+
+            for (int l = 0; l < lanes; l++) {
+                xs[l] = bx + l % block_width;
+                ys[l] = by + l / block_width;
+                valid[l] = xs[l] < tile.x1 && ys[l] < tile.y1;
+            }
+
+            for (int k = 0; k < num_samples; k++) {
+                Ray rays[lanes];
+                RayDifferential differentials[lanes];
+                Hit hits[lanes];
+                float weights[lanes];
+                int dimensions[lanes];
+
+                for (int l = 0; l < lanes; l++) {
+                    // Lanes past the tile edge repeat the first ray and are
+                    // ignored afterwards.
+                    rays[l] = valid[l] ? camera_ray(camera, sampler, xs[l], ys[l], k, weights[l], differentials[l]) : rays[0];
+                    dimensions[l] = sampler.current_dimension();
+                }
+
+                scene->intersect_packet(RayPacket<FloatN>(rays), hits);
+
+                HitRecord records[lanes];
+                Vec3 albedos[lanes];
+                int roots[lanes], shaded_lanes[lanes], num_shaded = 0;
+                TextureCoord coords[lanes];
+                Vec3 positions[lanes], colors[lanes];
+
+                for (int l = 0; l < lanes; l++) {
+                    records[l].did_hit = false;
+
+                    if (valid[l] && hits[l].hitable) {
+                        records[l] = finalize_hit(rays[l], hits[l]);
+                        find_texture_footprint(records[l], rays[l], &differentials[l], records[l].t * Vec3::length(rays[l].direction));
+
+                        roots[num_shaded] = records[l].material->albedo_node;
+                        coords[num_shaded] = shading_coord(records[l]);
+                        positions[num_shaded] = records[l].position;
+                        shaded_lanes[num_shaded++] = l;
+                    }
+                }
+
+                shading->evaluate(num_shaded, roots, coords, positions, colors);
+                for (int i = 0; i < num_shaded; i++) {
+                    albedos[shaded_lanes[i]] = colors[i];
+                }
+
+                for (int l = 0; l < lanes; l++) {
+                    if (valid[l]) {
+                        num_rays++;
+                        resume_pixel_sample(sampler, xs[l], ys[l], k, dimensions[l]);
+                        film.add_sample(xs[l], ys[l], color_path(rays[l], records[l], albedos[l], sampler), weights[l]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Which of the eight octants a direction points into, from its signs.
+static int octant(const Vec3 &direction) {
+    return (direction.x < 0.0) | ((direction.y < 0.0) << 1) | ((direction.z < 0.0) << 2);
+}
+
+// Orders indices by the octant of ray_of(index), with a counting sort, so
+// that runs of them fill coherent packets.
+template <class RayOf>
+static void sort_by_octant(const std::vector<int> &indices, const RayOf &ray_of, std::vector<int> &sorted) {
+    int starts[9] = { };
+
+    for (int i : indices) {
+        starts[octant(ray_of(i).direction) + 1]++;
+    }
+    for (int o = 1; o < 9; o++) {
+        starts[o] += starts[o - 1];
+    }
+
+    sorted.resize(indices.size());
+    for (int i : indices) {
+        sorted[starts[octant(ray_of(i).direction)]++] = i;
+    }
+}
+
+// Renders a tile a stage at a time rather than a path at a time: all of
+// the tile's camera rays, up to wavefront_size of them, are intersected,
+// the hits are sorted by the type of their material and shaded a type at a
+// time, the shadow rays that shading leaves are traced, and the paths that
+// go on are compacted into the queue for the next bounce. Both kinds of ray
+// are sorted by octant first and traced in packets of FloatN::width, whose
+// rays then share a traversal order through the BVH.
+//
+// Paths take turns on the thread's sampler, resuming their pixel samples
+// where they left off, and samples are added to the film in the order
+// render_tile() adds them, so the image comes out the same apart from where
+// the packet sphere test rounds differently from the single ray one.
+template <class FloatN>
+void Integrator::render_tile_wavefront(const Tile &tile, Camera &camera, Sampler &sampler, int num_samples, Film &film, Wavefront &wavefront) {
+    const int lanes = FloatN::width;
+    int tile_width = tile.x1 - tile.x0;
+    long long tile_samples = (long long) tile_width * (tile.y1 - tile.y0) * num_samples;
+    std::vector<WavefrontPath> &paths = wavefront.paths;
+    std::vector<int> &queue = wavefront.queue, &sorted = wavefront.sorted, &hits = wavefront.hits;
+    std::vector<int> &shaded = wavefront.shaded, &shadowed = wavefront.shadowed;
+
+    paths.resize(std::min<long long>(wavefront_size, tile_samples));
+
+    for (long long first = 0; first < tile_samples; first += paths.size()) {
+        int count = std::min<long long>(paths.size(), tile_samples - first);
+        queue.clear();
+
+        for (int i = 0; i < count; i++) {
+            WavefrontPath &path = paths[i];
+            long long sample = first + i;
+            int pixel = sample / num_samples;
+            path.x = tile.x0 + pixel % tile_width;
+            path.y = tile.y0 + pixel / tile_width;
+            path.sample_index = sample % num_samples;
+            path.state = PathState(camera_ray(camera, sampler, path.x, path.y, path.sample_index, path.weight, path.differential));
+            path.dimension = sampler.current_dimension();
+            queue.push_back(i);
+        }
+
+        for (int depth = 0; depth < max_depth && !queue.empty(); depth++) {
+            sort_by_octant(queue, [&](int i) -> const Ray & { return paths[i].state.ray; }, sorted);
+            hits.clear();
+
+            for (size_t start = 0; start < sorted.size(); start += lanes) {
+                int n = std::min<size_t>(lanes, sorted.size() - start);
+                Ray rays[lanes];
+                Hit packet_hits[lanes];
+
+                // Lanes past the end repeat the first ray and are ignored.
+                for (int l = 0; l < lanes; l++) {
+                    rays[l] = paths[sorted[start + (l < n ? l : 0)]].state.ray;
+                }
+
+                scene->intersect_packet(RayPacket<FloatN>(rays), packet_hits);
+
+                for (int l = 0; l < n; l++) {
+                    int i = sorted[start + l];
+                    WavefrontPath &path = paths[i];
+                    num_path_segments++;
+                    num_rays++;
+
+                    if (packet_hits[l].hitable) {
+                        HitRecord &hit_record = path.hit_record;
+                        hit_record = finalize_hit(rays[l], packet_hits[l]);
+                        path.state.path_length += hit_record.t * Vec3::length(rays[l].direction);
+                        find_texture_footprint(hit_record, rays[l], depth == 0 ? &path.differential : nullptr, path.state.path_length);
+                        hits.push_back(i);
+                    }
+                }
+            }
+
+            // A counting sort, so that each material type is shaded in one
+            // run rather than alternating between types from hit to hit.
+            int type_starts[MATERIAL_LIGHT + 2] = { };
+            for (int i : hits) {
+                type_starts[paths[i].hit_record.material->type + 1]++;
+            }
+            for (int type = 1; type < MATERIAL_LIGHT + 2; type++) {
+                type_starts[type] += type_starts[type - 1];
+            }
+
+            shaded.resize(hits.size());
+            for (int i : hits) {
+                shaded[type_starts[paths[i].hit_record.material->type]++] = i;
+            }
+
+            wavefront.roots.resize(shaded.size());
+            wavefront.coords.resize(shaded.size());
+            wavefront.positions.resize(shaded.size());
+            wavefront.colors.resize(shaded.size());
+
+            for (size_t j = 0; j < shaded.size(); j++) {
+                const HitRecord &hit_record = paths[shaded[j]].hit_record;
+                wavefront.roots[j] = hit_record.material->albedo_node;
+                wavefront.coords[j] = shading_coord(hit_record);
+                wavefront.positions[j] = hit_record.position;
+            }
+
+            shading->evaluate(shaded.size(), wavefront.roots.data(), wavefront.coords.data(), wavefront.positions.data(),
+                              wavefront.colors.data());
+
+            queue.clear();
+            shadowed.clear();
+
+            for (size_t j = 0; j < shaded.size(); j++) {
+                WavefrontPath &path = paths[shaded[j]];
+
+                resume_pixel_sample(sampler, path.x, path.y, path.sample_index, path.dimension);
+                bool alive = shade_hit(path.state, depth, path.hit_record, wavefront.colors[j], sampler, path.shadow);
+                path.dimension = sampler.current_dimension();
+
+                if (alive) {
+                    queue.push_back(shaded[j]);
+                }
+                if (path.shadow.active) {
+                    shadowed.push_back(shaded[j]);
+                }
+            }
+
+            sort_by_octant(shadowed, [&](int i) -> const Ray & { return paths[i].shadow.ray; }, sorted);
+
+            for (size_t start = 0; start < sorted.size(); start += lanes) {
+                int n = std::min<size_t>(lanes, sorted.size() - start);
+                Ray rays[lanes];
+                float distances[lanes];
+                bool blocked[lanes];
+
+                for (int l = 0; l < lanes; l++) {
+                    const ShadowRay &shadow = paths[sorted[start + (l < n ? l : 0)]].shadow;
+                    rays[l] = shadow.ray;
+                    distances[l] = shadow.distance;
+                    blocked[l] = l >= n;
+                }
+
+                scene->occluded_packet(RayPacket<FloatN>(rays), distances, blocked);
+
+                for (int l = 0; l < n; l++) {
+                    WavefrontPath &path = paths[sorted[start + l]];
+                    num_rays++;
+
+                    if (!blocked[l]) {
+                        path.state.color = path.state.color + path.shadow.contribution;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < count; i++) {
+            film.add_sample(paths[i].x, paths[i].y, paths[i].state.color, paths[i].weight);
+        }
+    }
+}
+
+RenderStats Integrator::render_image(Camera &camera, Sampler &sampler, int num_samples, int num_threads, Film &film) {
+    std::atomic<long long> total_rays(0);
+    std::atomic<long long> total_path_segments(0);
+
+    std::vector<Wavefront> wavefronts(wavefront ? num_threads : 0);
+    std::vector<std::unique_ptr<Sampler>> thread_samplers;
+    for (int i = 0; i < num_threads; i++) {
+        thread_samplers.push_back(std::unique_ptr<Sampler>(sampler.clone()));
+    }
+
+    film.clear();
+
+    render_tiles(width, height, tile_size, num_threads, [&](const Tile &tile, int thread_index) {
+        Sampler &thread_sampler = *thread_samplers[thread_index];
+        num_rays = 0;
+        num_path_segments = 0;
+
+        if (wavefront && packet_width == 4) {
+            render_tile_wavefront<Float4>(tile, camera, thread_sampler, num_samples, film, wavefronts[thread_index]);
+        }
+        else if (wavefront) {
+            render_tile_wavefront<Float8>(tile, camera, thread_sampler, num_samples, film, wavefronts[thread_index]);
+        }
+        else if (packet_width == 8) {
+            render_tile_packets<Float8>(tile, camera, thread_sampler, num_samples, film);
+        }
+        else if (packet_width == 4) {
+            render_tile_packets<Float4>(tile, camera, thread_sampler, num_samples, film);
+        }
+        else {
+            render_tile(tile, camera, thread_sampler, num_samples, film);
+        }
+
+        total_rays += num_rays;
+        total_path_segments += num_path_segments;
+    });
+
+    RenderStats stats;
+    stats.num_rays = total_rays;
+    stats.num_path_segments = total_path_segments;
+    stats.num_samples = (long long) width * height * num_samples;
+    return stats;
+}
+
+RenderStats Integrator::render_image_adaptive(Camera &camera, Sampler &sampler, const AdaptiveSettings &settings, int num_threads,
+                                  Film &film, std::vector<PixelEstimate> &pixels, int &num_passes) {
+    std::atomic<long long> total_rays(0);
+    std::atomic<long long> total_path_segments(0);
+
+    std::vector<std::unique_ptr<Sampler>> thread_samplers;
+    for (int i = 0; i < num_threads; i++) {
+        thread_samplers.push_back(std::unique_ptr<Sampler>(sampler.clone()));
+    }
+
+    film.clear();
+
+    num_passes = render_adaptive(width, height, tile_size, num_threads, settings, pixels, [&](int x, int y, int k, int thread_index) {
+        Sampler &thread_sampler = *thread_samplers[thread_index];
+        num_rays = 0;
+        num_path_segments = 0;
+
+        float weight;
+        RayDifferential differential;
+        Ray ray = camera_ray(camera, thread_sampler, x, y, k, weight, differential);
+        Vec3 color = color_ray(ray, differential, thread_sampler);
+        film.add_sample(x, y, color, weight);
+
+        total_rays += num_rays;
+        total_path_segments += num_path_segments;
+        return color;
+    });
+
+    RenderStats stats;
+    stats.num_rays = total_rays;
+    stats.num_path_segments = total_path_segments;
+    stats.num_samples = 0;
+
+    for (const PixelEstimate &pixel : pixels) {
+        stats.num_samples += pixel.num_samples;
+    }
+
+    return stats;
+}
+
+// Traces only camera rays, one per pixel and sample, to compare single
+// ray and packet traversal. Returns a checksum of the hit distances.
+template <class FloatN>
+double Integrator::trace_primary_rays(Camera &camera, Sampler &sampler, int num_samples, bool use_packets) {
+    const int lanes = FloatN::width;
+    const int block_width = lanes / 2;
+    double checksum = 0.0;
+
+    for (int k = 0; k < num_samples; k++) {
+        for (int by = 0; by < height; by += 2) {
+            for (int bx = 0; bx < width; bx += block_width) {
+                Ray rays[lanes];
+                Hit hits[lanes];
+
+                for (int l = 0; l < lanes; l++) {
+                    int x = (bx + l % block_width) % width;
+                    int y = (by + l / block_width) % height;
+                    float weight;
+                    RayDifferential differential;
+                    rays[l] = camera_ray(camera, sampler, x, y, k, weight, differential);
+                }
+
+                if (use_packets) {
+                    scene->intersect_packet(RayPacket<FloatN>(rays), hits);
+                }
+                else {
+                    for (int l = 0; l < lanes; l++) {
+                        scene->intersect(rays[l], FLT_MAX, hits[l]);
+                    }
+                }
+
+                for (int l = 0; l < lanes; l++) {
+                    checksum += hits[l].hitable ? hits[l].t : 0.0;
+                }
+            }
+        }
+    }
+
+    return checksum;
+}
+
+void Integrator::benchmark_primary_rays(Camera &camera, uint64_t seed) {
+    const int num_samples = 16;
+    const char *names[] = { "single", "packet4", "packet8" };
+
+    for (int mode = 0; mode < 3; mode++) {
+        std::unique_ptr<Sampler> sampler(create_sampler("random", num_samples, seed));
+
+        auto start_time = std::chrono::steady_clock::now();
+        double checksum = 0.0;
+        long long rays = 0;
+
+        if (mode == 0) {
+            checksum = trace_primary_rays<Float8>(camera, *sampler, num_samples, false);
+        }
+        else if (mode == 1) {
+            checksum = trace_primary_rays<Float4>(camera, *sampler, num_samples, true);
+        }
+        else {
+            checksum = trace_primary_rays<Float8>(camera, *sampler, num_samples, true);
+        }
+
+        auto end_time = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end_time - start_time).count();
+        rays = (long long) width * height * num_samples;
+
+        printf("%-8s %8.3f Mrays/s (checksum %.6e)\n", names[mode], rays / seconds / 1e6, checksum);
+    }
+}
+
+static float rmse(const Film &film, const Film &reference) {
+    double sum = 0.0;
+
+    for (int y = 0; y < film.height; y++) {
+        for (int x = 0; x < film.width; x++) {
+            Vec3 d = film.pixel_color(x, y) - reference.pixel_color(x, y);
+            sum += Vec3::dot(d, d) / 3.0;
+        }
+    }
+
+    return sqrt(sum / ((double) film.width * film.height));
+}
+
+void Integrator::benchmark_convergence(Camera &camera, int num_threads, uint64_t seed) {
+    const char *sampler_names[] = { "random", "stratified", "sobol", "bluenoise" };
+    const int sample_counts[] = { 4, 16, 64, 100 };
+    const int reference_samples = 1024;
+
+    Film reference(width, height);
+    Film film(width, height);
+
+    std::unique_ptr<Sampler> reference_sampler(create_sampler("sobol", reference_samples, seed + 1));
+    render_image(camera, *reference_sampler, reference_samples, num_threads, reference);
+
+    printf("%-12s", "spp");
+    for (int s : sample_counts) {
+        printf("%10d", s);
+    }
+    printf("\n");
+
+    for (const char *name : sampler_names) {
+        printf("%-12s", name);
+
+        for (int s : sample_counts) {
+            std::unique_ptr<Sampler> sampler(create_sampler(name, s, seed));
+            render_image(camera, *sampler, s, num_threads, film);
+            printf("%10.5f", rmse(film, reference));
+            fflush(stdout);
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "camera.h"
+#include "film.h"
+#include "hit_record.h"
+#include "hitables.h"
+#include "lights.h"
+#include "ray.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "shading_graph.h"
+#include "vec3.h"
+
+// A path between bounces: the ray it continues along and what it has
+// gathered so far.
+class PathState {
+    public:
+        Ray ray;
+        Vec3 color, throughput;
+        float scatter_pdf, path_length;
+        bool specular_bounce;
+
+        PathState() { };
+
+        PathState(const Ray &ray) {
+            this->ray = ray;
+            this->color = Vec3(0.0, 0.0, 0.0);
+            this->throughput = Vec3(1.0, 1.0, 1.0);
+            this->scatter_pdf = 0.0;
+            this->path_length = 0.0;
+            this->specular_bounce = true;
+        };
+};
+
+// A ray towards a point on a light, and what it adds to the color of its
+// path unless something blocks it.
+class ShadowRay {
+    public:
+        bool active;
+        Ray ray;
+        float distance;
+        Vec3 contribution;
+};
+
+// One path of a wavefront, the pixel sample it is for and how many of the
+// sample's dimensions it has used.
+class WavefrontPath {
+    public:
+        PathState state;
+        RayDifferential differential;
+        HitRecord hit_record;
+        ShadowRay shadow;
+        int x, y, sample_index, dimension;
+        float weight;
+};
+
+// The paths and queues of render_tile_wavefront(), kept from one tile to
+// the next by each thread.
+class Wavefront {
+    public:
+        std::vector<WavefrontPath> paths;
+        // Indices into paths. Queue holds the paths still going, hits the
+        // ones that found something, sorted by material type into shaded,
+        // and shadowed the ones with a shadow ray to trace. Sorted is the
+        // queue or shadowed sorted by octant.
+        std::vector<int> queue, sorted, hits, shaded, shadowed;
+        std::vector<int> roots;
+        std::vector<TextureCoord> coords;
+        std::vector<Vec3> positions, colors;
+};
+
+struct RenderStats {
+    long long num_rays;
+    long long num_path_segments;
+    long long num_samples;
+};
+
+// Path traces a scene into a Film, with next event estimation and multiple
+// importance sampling. Paths are traced one at a time, with their camera
+// rays in SIMD packets, or a bounce of many at a time, and each way gives
+// the same image up to rounding in the packet sphere test.
+class Integrator {
+    private:
+        void sample_direct_light(const Ray &ray, const HitRecord &hit_record, const Vec3 &albedo, Sampler &sampler, ShadowRay &shadow);
+        bool unoccluded(const ShadowRay &shadow);
+        void find_texture_footprint(HitRecord &hit_record, const Ray &ray, const RayDifferential *differential, float path_length);
+        bool shade_hit(PathState &path, int depth, const HitRecord &hit_record, const Vec3 &albedo, Sampler &sampler, ShadowRay &shadow);
+        Vec3 color_path(const Ray &ray, const HitRecord &first_hit, const Vec3 &first_albedo, Sampler &sampler);
+        Vec3 color_ray(const Ray &ray, const RayDifferential &differential, Sampler &sampler);
+        Ray camera_ray(Camera &camera, Sampler &sampler, int x, int y, int sample_index, float &weight, RayDifferential &differential);
+
+        void render_tile(const Tile &tile, Camera &camera, Sampler &sampler, int num_samples, Film &film);
+        template <class FloatN>
+        void render_tile_packets(const Tile &tile, Camera &camera, Sampler &sampler, int num_samples, Film &film);
+        template <class FloatN>
+        void render_tile_wavefront(const Tile &tile, Camera &camera, Sampler &sampler, int num_samples, Film &film, Wavefront &wavefront);
+
+        template <class FloatN>
+        double trace_primary_rays(Camera &camera, Sampler &sampler, int num_samples, bool use_packets);
+
+    public:
+        Hitable *scene;
+        LightList *lights;
+        ShadingGraph *shading;
+        Filter *filter;
+
+        int width, height;
+        // A multiple of Film::tile_width, so threads never share film cache
+        // lines.
+        int tile_size;
+        int packet_width;
+        bool wavefront;
+        // Paths a wavefront thread keeps in flight.
+        int wavefront_size;
+        bool light_sampling;
+        int max_depth, rr_depth;
+        // The angle a pixel subtends at the center of the image, which widens
+        // the texture footprint of secondary rays with the distance they have
+        // come.
+        float pixel_spread;
+        // Footprints shrink as pixels take more samples, which already
+        // average over the pixel between them.
+        float differential_scale;
+
+        Integrator() {
+            this->scene = nullptr;
+            this->lights = nullptr;
+            this->shading = nullptr;
+            this->filter = nullptr;
+            this->width = 200;
+            this->height = 200;
+            this->tile_size = 16;
+            this->packet_width = 8;
+            this->wavefront = false;
+            this->wavefront_size = 1 << 14;
+            this->light_sampling = true;
+            this->max_depth = 50;
+            this->rr_depth = 5;
+            this->pixel_spread = 0.0;
+            this->differential_scale = 1.0;
+        };
+
+        RenderStats render_image(Camera &camera, Sampler &sampler, int num_samples, int num_threads, Film &film);
+
+        // Renders with render_adaptive(), sampling every pixel only as often
+        // as its noise requires. Paths are traced one at a time, whatever
+        // wavefront is set to.
+        RenderStats render_image_adaptive(Camera &camera, Sampler &sampler, const AdaptiveSettings &settings, int num_threads,
+                                          Film &film, std::vector<PixelEstimate> &pixels, int &num_passes);
+
+        void benchmark_primary_rays(Camera &camera, uint64_t seed);
+
+        // Renders a high sample count reference with the Sobol sampler and
+        // reports the RMSE of every sampler against it over a range of
+        // sample counts.
+        void benchmark_convergence(Camera &camera, int num_threads, uint64_t seed);
+};
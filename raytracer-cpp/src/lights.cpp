@@ -0,0 +1,87 @@
+#include <math.h>
+
+#include "bvh_tree.h"
+#include "lights.h"
+
+LightList::LightList(const std::vector<Hitable*> &hitables) {
+    std::vector<TransformedHitable*> parents;
+
+    for (Hitable *hitable : hitables) {
+        add_lights(hitable, parents);
+    }
+}
+
+// parents are the transforms above hitable, outermost first.
+void LightList::add_lights(Hitable *hitable, std::vector<TransformedHitable*> &parents) {
+    if (!hitable) {
+        return;
+    }
+
+    if (hitable->type == HITABLE_TRANSFORMED) {
+        TransformedHitable *transformed = static_cast<TransformedHitable*>(hitable);
+        if (transformed->uniform_scale > 0.0) {
+            parents.push_back(transformed);
+            add_lights(transformed->hitable, parents);
+            parents.pop_back();
+        }
+        return;
+    }
+
+    if (hitable->type == HITABLE_BVH) {
+        for (Hitable *child : static_cast<BVHTree*>(hitable)->primitives.hitables()) {
+            add_lights(child, parents);
+        }
+        return;
+    }
+
+    // Only spheres and rects implement random_direction(). Other emitters,
+    // such as meshes, are left to the paths that hit them, which counts
+    // them fully as long as the list never picks them.
+    if (!hitable->material || !hitable->material->is_emissive() ||
+        (hitable->type != HITABLE_SPHERE && hitable->type != HITABLE_XY_RECT)) {
+        return;
+    }
+
+    Hitable *light = hitable;
+    for (int i = parents.size() - 1; i >= 0; i--) {
+        TransformedHitable *parent = parents[i];
+        transforms.emplace_back(new TransformedHitable(light, parent->translation, parent->rotation, parent->scale));
+        light = transforms.back().get();
+    }
+
+    lights.push_back(light);
+    materials.push_back(hitable->material);
+}
+
+Material *LightList::sample(const Vec3 &origin, float u_light, const Vec2 &u, Vec3 &direction, float &distance) {
+    int num_lights = lights.size();
+    int i = u_light * num_lights;
+
+    if (i > num_lights - 1) {
+        i = num_lights - 1;
+    }
+
+    direction = lights[i]->random_direction(origin, u, distance);
+
+    // A sphere around origin, for one, cannot be sampled from it.
+    if (distance <= 0.0 || lights[i]->pdf_value(origin, direction) <= 0.0) {
+        return nullptr;
+    }
+    return materials[i];
+}
+
+// Lights behind or in front of the one at t could not have been sampled
+// there, since the ray would have stopped at or been blocked by another.
+float LightList::pdf_value(const Vec3 &origin, const Vec3 &direction, float t) {
+    Ray ray(origin, direction);
+    float pdf = 0.0;
+
+    for (Hitable *light : lights) {
+        Hit hit;
+        if (light->intersect(ray, FLT_MAX, hit) && fabsf(hit.t - t) <= 1e-3f * (1.0f + t)) {
+            pdf += light->pdf_value(origin, direction);
+        }
+    }
+
+    return lights.empty() ? 0.0 : pdf / lights.size();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "hitables.h"
+#include "material.h"
+#include "vec3.h"
+
+// The emissive hitables of the scene, found by walking down through
+// TransformedHitables and the BVHs of objects. A light inside an instanced
+// object is sampled once per instance, through copies of the transforms
+// above it that the list owns. Lights stretched by a non-uniform scale, and
+// emitters other than spheres and rects, are not sampled, only found by the
+// paths that hit them. Lights are picked with equal probability.
+class LightList {
+    private:
+        std::vector<std::unique_ptr<TransformedHitable>> transforms;
+
+        void add_lights(Hitable *hitable, std::vector<TransformedHitable*> &parents);
+
+    public:
+        std::vector<Hitable*> lights;
+        std::vector<Material*> materials;
+
+        LightList(const std::vector<Hitable*> &hitables);
+
+        // Picks a light with u_light and a direction towards it with u,
+        // returning the light's material, or nullptr where the light picked
+        // cannot be sampled from origin.
+        Material *sample(const Vec3 &origin, float u_light, const Vec2 &u, Vec3 &direction, float &distance);
+
+        // Solid angle density of sample() picking direction and reaching
+        // the emitter t along it, summed over the lights there. Emitters
+        // the list does not sample have none.
+        float pdf_value(const Vec3 &origin, const Vec3 &direction, float t);
+};
@@ -1,156 +1,682 @@
 #define STB_IMAGE_IMPLEMENTATION
 
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
 
+#include "bvh_tree.h"
 #include "hitables.h"
+#include "image_writer.h"
+#include "integrator.h"
+#include "lights.h"
+#include "renderer.h"
 #include "camera.h"
+#include "film.h"
+#include "image_reader.h"
+#include "sampler.h"
+#include "scene.h"
+#include "shading_graph.h"
+#include "tonemap.h"
 #include "ray.h"
 #include "vec3.h"
 
-int width = 200;
-int height = 200;
-int num_samples = 100;
+static const int default_num_samples = 100;
 
-HitableList hitables;
+// Limits of the numeric options.
+static const int max_image_size = 16384;
+static const int max_path_depth = 10000;
+static const int max_texture_cache_mb = 1 << 20;
+static const double max_exposure = 64.0;
 
-Vec3 color_ray(const Ray &ray) {
-    int depth = 0;
-    Ray current_ray = ray;
-    Vec3 color = Vec3(1.0, 1.0, 1.0);
-    
-    while (depth < 50) {
-        HitRecord hit_record = hitables.intersect(current_ray);
+// Writes linear values to the HDR formats and tonemaps them for the others.
+bool output_picture(const char *path, ImageFormat format, const Tonemapper &tonemapper, int width, int height, const float *rgb) {
+    if (is_hdr_format(format)) {
+        return write_image(path, format, width, height, rgb);
+    }
+
+    std::vector<unsigned char> bytes(3 * (size_t) width * height);
+    tonemapper.apply(rgb, bytes.size(), &bytes[0]);
+
+    if (format == IMAGE_FORMAT_PNG) {
+        return write_png(path, width, height, &bytes[0]);
+    }
+    return write_ppm(path, width, height, &bytes[0]);
+}
+
+// Writes the number of samples each pixel took, from blue for the fewest
+// through green to red for the most.
+bool output_heatmap(const char *path, int width, int height, const std::vector<PixelEstimate> &pixels) {
+    ImageFormat format;
+    if (!image_format_from_path(path, format)) {
+        fprintf(stderr, "Unknown image format for '%s', writing PPM\n", path);
+        format = IMAGE_FORMAT_PPM;
+    }
+
+    int min_samples = INT_MAX, max_samples = 0;
+    for (const PixelEstimate &pixel : pixels) {
+        min_samples = std::min(min_samples, pixel.num_samples);
+        max_samples = std::max(max_samples, pixel.num_samples);
+    }
+
+    std::vector<float> rgb(3 * pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        float t = max_samples > min_samples ? (float) (pixels[i].num_samples - min_samples) / (max_samples - min_samples) : 0.0;
+        Vec3 color = Vec3::clamp(Vec3(2.0 * t - 1.0, 1.0 - fabs(2.0 * t - 1.0), 1.0 - 2.0 * t), 0.0, 1.0);
+        rgb[3 * i + 0] = color.x;
+        rgb[3 * i + 1] = color.y;
+        rgb[3 * i + 2] = color.z;
+    }
+
+    return write_image(path, format, width, height, &rgb[0]);
+}
+
+double peak_resident_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+// Writes a scene of num_primitives random spheres and transformed boxes to a
+// temporary file and times loading it.
+void benchmark_scene_loading(int num_primitives, uint64_t seed) {
+    FILE *file = tmpfile();
+    if (!file) {
+        fprintf(stderr, "Could not create a temporary file\n");
+        return;
+    }
+
+    srand(seed);
+    fprintf(file, "camera 0 0 -800  -300 -300 -305  599 0 0  0 599 0\n");
+    fprintf(file, "texture red constant 0.8 0.2 0.2\ntexture green constant 0.2 0.8 0.2\n");
+    fprintf(file, "material red lambertian red\nmaterial green lambertian green\n");
+
+    for (int i = 0; i < num_primitives; i++) {
+        float x = 600.0 * rand() / RAND_MAX - 300.0;
+        float y = 600.0 * rand() / RAND_MAX - 300.0;
+        float z = 600.0 * rand() / RAND_MAX - 300.0;
+
+        if (i % 4 == 3) {
+            fprintf(file, "transform %.4f %.4f %.4f  0 %.2f 0  1 1 1\n", x, y, z, 360.0 * rand() / RAND_MAX);
+            fprintf(file, "box red -1 -1 -1 1 1 1\n");
+        }
+        else {
+            fprintf(file, "sphere %s %.4f %.4f %.4f %.4f\n", i % 2 ? "red" : "green", x, y, z, 2.0 * rand() / RAND_MAX);
+        }
+    }
+
+    long size = ftell(file);
+    rewind(file);
+
+    std::unique_ptr<Scene> scene(new Scene());
+    auto start_time = std::chrono::steady_clock::now();
+    bool loaded = load_scene(file, "benchmark", "", *scene);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    fclose(file);
+
+    if (loaded) {
+        printf("load: %d primitives, %d hitables, %.1f MB in %.3f s, %.1f MB/s, %.2f Mprimitives/s\n", num_primitives,
+               (int) scene->hitables.size(), size / 1e6, seconds, size / 1e6 / seconds, num_primitives / seconds / 1e6);
+        printf("memory: %.1f MB in the scene arena, %.1f MB peak resident\n", scene->arena.size() / 1e6, peak_resident_mb());
+    }
+
+    start_time = std::chrono::steady_clock::now();
+    scene.reset();
+    printf("free: %.3f s\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+// The default scene ships in scenes/ next to the executable, so it is found
+// from any working directory.
+std::string default_scene_path(const char *argv0) {
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    std::string executable = length > 0 ? std::string(path, length) : std::string(argv0);
+
+    size_t slash = executable.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : executable.substr(0, slash);
+    return directory + "/scenes/cornell.scene";
+}
+
+// Returns false unless text is a whole decimal number from min to max.
+bool parse_int(const char *text, int min, int max, int &value) {
+    char *end;
+    errno = 0;
+    long result = strtol(text, &end, 10);
+
+    if (end == text || *end != '\0' || errno == ERANGE || result < min || result > max) {
+        return false;
+    }
+
+    value = result;
+    return true;
+}
+
+// Returns false unless text is a whole finite number from min to max.
+bool parse_double(const char *text, double min, double max, double &value) {
+    char *end;
+    errno = 0;
+    double result = strtod(text, &end);
+
+    if (end == text || *end != '\0' || errno == ERANGE || !isfinite(result) || result < min || result > max) {
+        return false;
+    }
+
+    value = result;
+    return true;
+}
+
+void print_usage(const char *program) {
+    Integrator defaults;
+
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --scene path             scene file to render (default scenes/cornell.scene next to the executable)\n");
+    fprintf(stderr, "  --accel bvh|list         acceleration structure (default bvh)\n");
+    fprintf(stderr, "  --threads n              number of render threads\n");
+    fprintf(stderr, "  --sampler name           random, stratified, sobol or bluenoise (default sobol)\n");
+    fprintf(stderr, "  --width n                image width, up to %d (default %d)\n", Film::max_resolution, defaults.width);
+    fprintf(stderr, "  --height n               image height, up to %d (default %d)\n", Film::max_resolution, defaults.height);
+    fprintf(stderr, "  --spp n                  samples per pixel, the most any pixel takes when adaptive (default %d)\n", default_num_samples);
+    fprintf(stderr, "  --seed n                 sampler seed\n");
+    fprintf(stderr, "  --packets off|4|8        trace camera rays in SIMD packets, the wavefront traces all rays in packets of 4 or else 8 (default 8)\n");
+    fprintf(stderr, "  --integrator name        megakernel traces each path to its end, wavefront a bounce of many at a time but never adaptively (default megakernel)\n");
+    fprintf(stderr, "  --light-sampling on|off  sample lights directly at every bounce (default on)\n");
+    fprintf(stderr, "  --max-depth n            longest path in segments (default %d)\n", defaults.max_depth);
+    fprintf(stderr, "  --rr-depth n             bounces before Russian roulette starts, max-depth or more disables it (default %d)\n", defaults.rr_depth);
+    fprintf(stderr, "  --noise-target e         sample adaptively until the noise of every pixel is below e (0.05 is fine)\n");
+    fprintf(stderr, "  --time-budget s          sample adaptively, spending s seconds on the noisiest pixels\n");
+    fprintf(stderr, "  --min-spp n              samples every pixel takes before adapting (default %d)\n", AdaptiveSettings().min_samples);
+    fprintf(stderr, "  --output path            image to write, format from the extension (default image.ppm)\n");
+    fprintf(stderr, "  --format ppm|png|pfm|exr output format, pfm and exr keep linear HDR values\n");
+    fprintf(stderr, "  --filter name            box, tent, gaussian or mitchell pixel filter (default box)\n");
+    fprintf(stderr, "  --texture-filter name    nearest, bilinear, trilinear or ewa for every image texture, overriding the scene\n");
+    fprintf(stderr, "  --texture-compression on|off store 8-bit RGB image textures as BC1 blocks, overriding the scene\n");
+    fprintf(stderr, "  --texture-cache mb       memory for image texture tiles (default %d)\n", (int) (TextureCache::default_capacity >> 20));
+    fprintf(stderr, "  --texture-tiles dir      keep image texture tiles in dir for later runs instead of in temporary files\n");
+    fprintf(stderr, "  --tonemap name           clamp, reinhard or aces, applied before sRGB encoding (default clamp)\n");
+    fprintf(stderr, "  --exposure ev            scale by 2^ev before tonemapping (default 0)\n");
+    fprintf(stderr, "  --tonemap-input path     tonemap a saved .pfm or .exr render to --output instead of rendering\n");
+    fprintf(stderr, "  --heatmap path           write the samples each pixel took, for adaptive sampling\n");
+    fprintf(stderr, "  --bench-primary          compare single ray and packet camera ray throughput\n");
+    fprintf(stderr, "  --bench-convergence      report RMSE against a reference for every sampler\n");
+    fprintf(stderr, "  --bench-load n           time loading a generated scene of n primitives\n");
+    fprintf(stderr, "  --stats                  print build and render statistics\n");
+}
+
+int main(int argc, char **argv) {
+    Integrator integrator;
+    int width = integrator.width;
+    int height = integrator.height;
+    int num_samples = default_num_samples;
+    bool use_bvh = true;
+    bool print_stats = false;
+    int num_threads = std::thread::hardware_concurrency();
+    unsigned long long seed = 0;
+    const char *sampler_name = "sobol";
+    bool bench_convergence = false;
+    bool bench_primary = false;
+    int bench_load_primitives = 0;
+    std::string default_scene = default_scene_path(argv[0]);
+    const char *scene_path = default_scene.c_str();
+    const char *heatmap_path = nullptr;
+    const char *output_path = nullptr;
+    const char *format_name = nullptr;
+    const char *filter_name = "box";
+    const char *texture_filter_name = nullptr;
+    // -1 leaves it to the scene.
+    int texture_compression = -1;
+    int texture_cache_mb = TextureCache::default_capacity >> 20;
+    const char *texture_tile_directory = nullptr;
+    const char *tonemap_name = "clamp";
+    const char *tonemap_input_path = nullptr;
+    float exposure = 0.0;
 
-        if (hit_record.did_hit) {
-            ScatterResult scatter_result = hit_record.material->scatter(current_ray, hit_record.position, hit_record.normal, hit_record.texture_coord);
-            Vec3 emitted_light = hit_record.material->emitted(hit_record.position);
+    AdaptiveSettings adaptive;
 
-            if (scatter_result.did_scatter) {
-                Vec3 ray_color = scatter_result.color;
-                color = emitted_light + 
-                        Vec3(color.x * scatter_result.color.x,
-                             color.y * scatter_result.color.y,
-                             color.z * scatter_result.color.z);
-                current_ray = scatter_result.ray;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            scene_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--accel") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "list") == 0) {
+                use_bvh = false;
+            }
+            else if (strcmp(argv[i], "bvh") == 0) {
+                use_bvh = true;
+            }
+            else {
+                fprintf(stderr, "Unknown acceleration structure '%s', expected bvh or list\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 1, 4096, num_threads)) {
+                fprintf(stderr, "Invalid thread count '%s', expected 1 to 4096\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            i++;
+            char *end;
+            errno = 0;
+            seed = strtoull(argv[i], &end, 10);
+            if (end == argv[i] || *end != '\0' || errno == ERANGE || argv[i][0] == '-') {
+                fprintf(stderr, "Invalid seed '%s', expected a number from 0 to %llu\n", argv[i], ULLONG_MAX);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc) {
+            sampler_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 1, max_image_size, width)) {
+                fprintf(stderr, "Invalid width '%s', expected 1 to %d\n", argv[i], max_image_size);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 1, max_image_size, height)) {
+                fprintf(stderr, "Invalid height '%s', expected 1 to %d\n", argv[i], max_image_size);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc) {
+            if (!parse_int(argv[++i], 1, INT_MAX, num_samples)) {
+                fprintf(stderr, "Invalid sample count '%s', expected a positive number\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--packets") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "off") == 0) {
+                integrator.packet_width = 0;
+            }
+            else if (!parse_int(argv[i], 4, 8, integrator.packet_width) || (integrator.packet_width != 4 && integrator.packet_width != 8)) {
+                fprintf(stderr, "Unknown packet width '%s', expected off, 4 or 8\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--integrator") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "wavefront") == 0) {
+                integrator.wavefront = true;
+            }
+            else if (strcmp(argv[i], "megakernel") == 0) {
+                integrator.wavefront = false;
+            }
+            else {
+                fprintf(stderr, "Unknown integrator '%s', expected megakernel or wavefront\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--light-sampling") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "on") == 0) {
+                integrator.light_sampling = true;
+            }
+            else if (strcmp(argv[i], "off") == 0) {
+                integrator.light_sampling = false;
             }
             else {
-                return Vec3(color.x * emitted_light.x, color.y * emitted_light.y, color.z * emitted_light.z);
+                fprintf(stderr, "Unknown light sampling mode '%s', expected on or off\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 1, max_path_depth, integrator.max_depth)) {
+                fprintf(stderr, "Invalid path depth '%s', expected 1 to %d\n", argv[i], max_path_depth);
+                return 1;
             }
         }
+        else if (strcmp(argv[i], "--rr-depth") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 0, max_path_depth, integrator.rr_depth)) {
+                fprintf(stderr, "Invalid Russian roulette depth '%s', expected 0 to %d\n", argv[i], max_path_depth);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--noise-target") == 0 && i + 1 < argc) {
+            i++;
+            double noise_target;
+            if (!parse_double(argv[i], 0.0, HUGE_VAL, noise_target)) {
+                fprintf(stderr, "Invalid noise target '%s', expected a number from 0\n", argv[i]);
+                return 1;
+            }
+            adaptive.noise_target = noise_target;
+        }
+        else if (strcmp(argv[i], "--time-budget") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_double(argv[i], 0.0, HUGE_VAL, adaptive.time_budget)) {
+                fprintf(stderr, "Invalid time budget '%s', expected a number of seconds from 0\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--min-spp") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 1, INT_MAX, adaptive.min_samples)) {
+                fprintf(stderr, "Invalid sample count '%s', expected a positive number\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--texture-filter") == 0 && i + 1 < argc) {
+            texture_filter_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--texture-compression") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "on") == 0) {
+                texture_compression = 1;
+            }
+            else if (strcmp(argv[i], "off") == 0) {
+                texture_compression = 0;
+            }
+            else {
+                fprintf(stderr, "Unknown texture compression mode '%s', expected on or off\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--texture-cache") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 0, max_texture_cache_mb, texture_cache_mb)) {
+                fprintf(stderr, "Invalid texture cache size '%s', expected 0 to %d MB\n", argv[i], max_texture_cache_mb);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--texture-tiles") == 0 && i + 1 < argc) {
+            texture_tile_directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tonemap") == 0 && i + 1 < argc) {
+            tonemap_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--exposure") == 0 && i + 1 < argc) {
+            i++;
+            double ev;
+            if (!parse_double(argv[i], -max_exposure, max_exposure, ev)) {
+                fprintf(stderr, "Invalid exposure '%s', expected %g to %g\n", argv[i], -max_exposure, max_exposure);
+                return 1;
+            }
+            exposure = ev;
+        }
+        else if (strcmp(argv[i], "--tonemap-input") == 0 && i + 1 < argc) {
+            tonemap_input_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            heatmap_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench-load") == 0 && i + 1 < argc) {
+            i++;
+            if (!parse_int(argv[i], 1, INT_MAX, bench_load_primitives)) {
+                fprintf(stderr, "Invalid primitive count '%s', expected a positive number\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-primary") == 0) {
+            bench_primary = true;
+        }
+        else if (strcmp(argv[i], "--bench-convergence") == 0) {
+            bench_convergence = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = true;
+        }
         else {
-            return Vec3(0.0, 0.0, 0.0);
+            print_usage(argv[0]);
+            return 1;
         }
+    }
 
-        depth++;
+    bool use_adaptive = adaptive.noise_target > 0.0 || adaptive.time_budget > 0.0;
+    if (use_adaptive && integrator.wavefront) {
+        fprintf(stderr, "--integrator wavefront cannot sample adaptively, leave out --noise-target and --time-budget\n");
+        return 1;
     }
 
-    return Vec3(0.0, 0.0, 0.0);
-}
+    ImageFormat output_format = IMAGE_FORMAT_PPM;
+    if (format_name && !parse_image_format(format_name, output_format)) {
+        fprintf(stderr, "Unknown image format '%s', expected ppm, png, pfm or exr\n", format_name);
+        return 1;
+    }
+    else if (!format_name && output_path && !image_format_from_path(output_path, output_format)) {
+        fprintf(stderr, "Unknown image format for '%s', use --format\n", output_path);
+        return 1;
+    }
+
+    std::string default_output_path = std::string("image.") + image_format_name(output_format);
+    if (!output_path) {
+        output_path = default_output_path.c_str();
+    }
 
-void output_picture(Vec3 *colors) {
-    FILE *img_file = fopen("image.ppm", "w");
+    TonemapOperator tonemap_operator;
+    if (!parse_tonemap_operator(tonemap_name, tonemap_operator)) {
+        fprintf(stderr, "Unknown tonemapping operator '%s', expected clamp, reinhard or aces\n", tonemap_name);
+        return 1;
+    }
+    Tonemapper tonemapper(tonemap_operator, exposure);
 
-    fprintf(img_file, "P3\n");
-    fprintf(img_file, "%d %d\n", width, height);
-    fprintf(img_file, "%d\n", 255);
+    if (tonemap_input_path) {
+        int input_width, input_height;
+        std::vector<float> rgb;
 
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            Vec3 color = colors[i * height + j]; 
-            color.x = sqrt(color.x);
-            color.y = sqrt(color.y);
-            color.z = sqrt(color.z);
-            color = Vec3::clamp(color, 0.0, 1.0); 
+        if (is_hdr_format(output_format)) {
+            fprintf(stderr, "--tonemap-input needs an 8-bit output format\n");
+            return 1;
+        }
 
-            int r = (int) (color.x * 255);
-            int g = (int) (color.y * 255);
-            int b = (int) (color.z * 255);
-            fprintf(img_file, "%d %d %d\n", r, g, b);
+        if (!read_image(tonemap_input_path, input_width, input_height, rgb)) {
+            return 1;
         }
+
+        return output_picture(output_path, output_format, tonemapper, input_width, input_height, &rgb[0]) ? 0 : 1;
     }
-}
 
-int main() {
-    Sphere s1(Vec3(0.0, -102.0, 0.0), 100.0);
-    ConstantTexture t1(Vec3(0.8, 0.8, 0.8));
-    ConstantTexture t2(Vec3(0.2, 0.2, 0.2));
-    CheckeredTexture s1_texture(&t1, &t2);
-    LambertianMaterial s1_material(&s1_texture);
-    s1.material = &s1_material;
+    std::unique_ptr<Filter> owned_filter(create_filter(filter_name));
+    if (!owned_filter) {
+        fprintf(stderr, "Unknown filter '%s', expected box, tent, gaussian or mitchell\n", filter_name);
+        return 1;
+    }
+    integrator.filter = owned_filter.get();
 
-    Sphere s2(Vec3(0.0, 0.0, 0.0), 2.0);
-    ConstantTexture s2_texture(Vec3(0.2, 0.8, 0.2));
-    LambertianMaterial s2_material(&s2_texture);
-    s2.material = &s2_material;
+    TextureFilter texture_filter;
+    if (texture_filter_name && !parse_texture_filter(texture_filter_name, texture_filter)) {
+        fprintf(stderr, "Unknown texture filter '%s', expected nearest, bilinear, trilinear or ewa\n", texture_filter_name);
+        return 1;
+    }
 
-    Sphere s3(Vec3(3.0, -1.0, 0.0), 1.0);
-    ConstantTexture s3_texture(Vec3(0.5, 0.5, 0.5));
-    MetalMaterial s3_material(&s3_texture);
-    s3.material = &s3_material;
+    if (bench_load_primitives > 0) {
+        benchmark_scene_loading(bench_load_primitives, seed);
+        return 0;
+    }
 
-    Sphere s4(Vec3(-3.0, -1.0, 0.0), 1.0);
-    ImageTexture s4_texture("earth.jpg");
-    LambertianMaterial s4_material(&s4_texture);
-    s4.material = &s4_material;
+    Scene world;
+    world.texture_cache.set_capacity((size_t) texture_cache_mb << 20);
+    world.texture_compression = texture_compression;
+    if (texture_tile_directory) {
+        world.texture_tile_directory = texture_tile_directory;
+    }
+    auto load_start_time = std::chrono::steady_clock::now();
+    if (!load_scene(scene_path, world)) {
+        return 1;
+    }
+    double load_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start_time).count();
 
-    XYRect r1(Vec3(-300.0, -300.0, 0.0), Vec3(300.0, 300.0, 0.0));
-    r1.material = &s2_material;
-    TransformedHitable side1(&r1, Vec3(300.0, 0.0, 0.0), Vec3(0.0, -0.5 * M_PI, 0.0), Vec3(1.0, 1.0, 1.0));
+    HitableList hitables;
+    for (Hitable *hitable : world.roots) {
+        hitables.add(hitable);
+    }
+
+    for (Texture *texture : world.textures) {
+        if (texture->type == TEXTURE_IMAGE && texture_filter_name) {
+            static_cast<ImageTexture*>(texture)->filter = texture_filter;
+        }
+    }
+
+    BVHTree bvh(hitables.hitables());
+    LightList light_list(hitables.hitables());
+    ShadingGraph shading_graph(world.materials);
+    integrator.scene = &hitables;
+    integrator.lights = &light_list;
+    integrator.shading = &shading_graph;
+    if (use_bvh) {
+        integrator.scene = &bvh;
+    }
+
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    std::unique_ptr<Sampler> sampler(create_sampler(sampler_name, num_samples, seed));
+    if (!sampler) {
+        fprintf(stderr, "Unknown sampler '%s'\n", sampler_name);
+        return 1;
+    }
 
-    XYRect r2(Vec3(-300.0, -300.0, 0.0), Vec3(300.0, 300.0, 0.0));
-    r2.material = &s2_material;
-    TransformedHitable side2(&r2, Vec3(-300.0, 0.0, 0.0), Vec3(0.0, 0.5 * M_PI, 0.0), Vec3(1.0, 1.0, 1.0));
+    if (print_stats) {
+        printf("scene: %s, %d hitables, %lld triangles, %lld instances, %d materials, %d textures, loaded in %.3f ms\n",
+               scene_path, (int) world.hitables.size(), world.num_triangles, world.num_instances, (int) world.materials.size(),
+               (int) world.textures.size(), 1000.0 * load_time);
+        if (use_bvh) {
+            printf("bvh: %d hitables, %d nodes, depth %d, built in %.3f ms\n",
+                   (int) bvh.primitives.hitables().size(), (int) bvh.nodes.size(), bvh.depth, 1000.0 * bvh.build_time);
+        }
+        else {
+            printf("list: %d hitables\n", (int) hitables.hitables().size());
+        }
 
-    XYRect r3(Vec3(-300.0, -300.0, 0.0), Vec3(300.0, 300.0, 0.0));
-    r3.material = &s2_material;
-    TransformedHitable side3(&r3, Vec3(0.0, 0.0, 300.0), Vec3(M_PI, 0.0, 0.0), Vec3(1.0, 1.0, 1.0));
+        printf("memory: %.1f MB in the scene arena, %.1f MB peak resident\n", world.arena.size() / 1e6, peak_resident_mb());
+    }
 
-    XYRect r4(Vec3(-300.0, -300.0, 0.0), Vec3(300.0, 300.0, 0.0));
-    r4.material = &s2_material;
-    TransformedHitable side4(&r4, Vec3(0.0, 300.0, 0.0), Vec3(0.5 * M_PI, 0.0, 0.0), Vec3(1.0, 1.0, 1.0));
+    if (width < 1 || width > Film::max_resolution || height < 1 || height > Film::max_resolution) {
+        fprintf(stderr, "Image size %dx%d is outside 1x1 to %dx%d\n", width, height, Film::max_resolution, Film::max_resolution);
+        return 1;
+    }
 
-    XYRect r5(Vec3(-300.0, -300.0, 0.0), Vec3(300.0, 300.0, 0.0));
-    r5.material = &s2_material;
-    TransformedHitable side5(&r5, Vec3(0.0, -300.0, 0.0), Vec3(-0.5 * M_PI, 0.0, 0.0), Vec3(1.0, 1.0, 1.0));
+    // Wider images see more of the scene to the sides rather than stretching it.
+    float aspect = (float) width / height;
+    Camera camera = world.camera;
+    camera.lower_left = camera.lower_left - (0.5 * (aspect - 1.0)) * camera.width;
+    camera.width = aspect * camera.width;
+    integrator.width = width;
+    integrator.height = height;
+    integrator.pixel_spread = Vec3::length(camera.width) / width /
+                              Vec3::length(camera.lower_left + 0.5 * (camera.width + camera.height) - camera.origin);
+    integrator.differential_scale = fmaxf(0.125, 1.0 / sqrtf(num_samples));
 
-    ConstantTexture light_texture(Vec3(1.5, 1.5, 1.5));
-    DiffuseLightMaterial light_material(&light_texture);
-    XYRect light(Vec3(-200.0, -200.0, 0.0), Vec3(200.0, 200.0, 0.0));
-    light.material = &light_material;
-    TransformedHitable transformed_light(&light, Vec3(0.0, 299.0, 0.0), Vec3(0.5 * M_PI, 0.0, 0.0), Vec3(1.0, 1.0, 1.0));
+    if (print_stats) {
+        AABB bounds = hitables.bounding_box();
+        printf("bounds: (%g %g %g) to (%g %g %g)\n", bounds.min.x, bounds.min.y, bounds.min.z,
+               bounds.max.x, bounds.max.y, bounds.max.z);
+    }
 
-    ConstantTexture box_texture(Vec3(0.8, 0.2, 0.2));
-    LambertianMaterial box_material(&box_texture);
-    Box box(Vec3(-100.0, -100.0, -100.0), Vec3(100.0, 100.0, 100.0));
-    box.material = &box_material;
-    TransformedHitable transformed_box(&box, Vec3(-100.0, -200.0, 100.0), Vec3(0.0, 0.2 * M_PI, 0.0), Vec3(1.0, 1.0, 1.0));
+    if (bench_primary) {
+        integrator.benchmark_primary_rays(camera, seed);
+        return 0;
+    }
 
-    //hitables.hitables.push_back(&s1);
-    hitables.hitables.push_back(&side1);
-    hitables.hitables.push_back(&side2);
-    hitables.hitables.push_back(&side3);
-    hitables.hitables.push_back(&side4);
-    hitables.hitables.push_back(&side5);
-    hitables.hitables.push_back(&transformed_light);
-    hitables.hitables.push_back(&transformed_box);
+    if (bench_convergence) {
+        integrator.benchmark_convergence(camera, num_threads, seed);
+        return 0;
+    }
 
-    Camera camera(Vec3(0.0, 0.0, -800.0), Vec3(-300.0, -300.0, -305.0), Vec3(599.0, 0.0, 0.0), Vec3(0.0, 599.0, 0.0));
-    Vec3 colors[width * height];
+    Film film(width, height);
 
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            colors[i * height + j] = Vec3(0.0, 0.0, 0.0);
+    auto start_time = std::chrono::steady_clock::now();
 
-            for (int k = 0; k < num_samples; k++) {
-                float u = (float) (j + RAND(-0.5, 0.5)) / width;
-                float v = 1.0 - ((float) (i + RAND(-0.5, 0.5)) / height);
+    std::vector<PixelEstimate> pixels;
+    int num_passes = 0;
+    RenderStats stats;
 
-                colors[i * height + j] = colors[i * height + j] + color_ray(camera.create_ray(u, v));
+    if (use_adaptive) {
+        adaptive.max_samples = num_samples;
+        adaptive.min_samples = std::max(2, std::min(adaptive.min_samples, num_samples));
+        stats = integrator.render_image_adaptive(camera, *sampler, adaptive, num_threads, film, pixels, num_passes);
+    }
+    else {
+        stats = integrator.render_image(camera, *sampler, num_samples, num_threads, film);
+    }
+
+    auto end_time = std::chrono::steady_clock::now();
+    double render_time = std::chrono::duration<double>(end_time - start_time).count();
+
+    if (print_stats) {
+        long long total_samples = stats.num_samples;
+        printf("render: %d threads, %.3f s, %lld rays, %.3f Mrays/s, %.0f samples/s, %.2f segments/path\n",
+               num_threads, render_time, stats.num_rays, stats.num_rays / render_time / 1e6, total_samples / render_time,
+               (double) stats.num_path_segments / total_samples);
+
+        if (use_adaptive) {
+            printf("adaptive: %d passes, %.1f samples/pixel on average\n", num_passes, (double) total_samples / ((double) width * height));
+        }
+
+        size_t format_bytes[4] = { 0, 0, 0, 0 };
+        int num_images = 0;
+        for (Texture *texture : world.textures) {
+            ImageTexture *image = texture->type == TEXTURE_IMAGE ? static_cast<ImageTexture*>(texture) : nullptr;
+            if (image && image->size_bytes() > 0) {
+                format_bytes[image->format] += image->size_bytes();
+                num_images++;
             }
+        }
 
-            colors[i * height + j] = (1.0 / num_samples) * colors[i * height + j];
+        if (num_images > 0) {
+            printf("textures: %d images,", num_images);
+            for (int format = 0; format < 4; format++) {
+                if (format_bytes[format] > 0) {
+                    printf(" %.2f MB %s", format_bytes[format] / 1048576.0, texture_format_name((TextureFormat) format));
+                }
+            }
+            printf("\n");
+        }
+
+        TextureCacheStats cache_stats = world.texture_cache.stats();
+        if (cache_stats.hits + cache_stats.misses > 0) {
+            printf("texture cache: %.1f of %.1f MB, %lld hits, %lld misses, %.2f%% hit rate, %lld evictions\n",
+                   cache_stats.bytes / 1048576.0, world.texture_cache.capacity_bytes() / 1048576.0, cache_stats.hits, cache_stats.misses,
+                   100.0 * cache_stats.hits / (cache_stats.hits + cache_stats.misses), cache_stats.evictions);
         }
     }
 
-    output_picture(colors);
+    auto write_start_time = std::chrono::steady_clock::now();
+
+    std::vector<float> rgb(3 * (size_t) width * height);
+    film.resolve(&rgb[0]);
+    if (!output_picture(output_path, output_format, tonemapper, width, height, &rgb[0])) {
+        return 1;
+    }
+
+    if (print_stats) {
+        double write_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - write_start_time).count();
+        printf("output: %s, %.3f ms\n", output_path, 1000.0 * write_time);
+    }
+
+    if (heatmap_path) {
+        if (use_adaptive) {
+            if (!output_heatmap(heatmap_path, width, height, pixels)) {
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "--heatmap needs --noise-target or --time-budget\n");
+        }
+    }
 }
@@ -1,41 +1,48 @@
 #include "material.h"
 
-ScatterResult LambertianMaterial::scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord) {
+ScatterResult Material::scatter(const Vec3 &albedo, const Ray &ray, const Vec3 &position, const Vec3 &normal, Sampler &sampler) const {
     ScatterResult result;
 
-    Vec3 target = normal + Vec3::random_in_unit_sphere();
-    result.ray = Ray(position, Vec3::normalize(target)); 
-    result.color = albedo->value(texture_coord, position);
-    result.did_scatter = true;
+    switch (type) {
+        case MATERIAL_LAMBERTIAN: {
+            Vec2 u = sampler.next_2d();
+            Vec3 target = Vec3::sample_cosine_hemisphere(normal, u.x, u.y);
+            result.ray = Ray(position, Vec3::normalize(target));
+            result.color = albedo;
+            result.pdf = pdf(ray, result.ray.direction, normal);
+            result.is_specular = false;
+            result.did_scatter = true;
+            break;
+        }
+        case MATERIAL_METAL: {
+            Vec3 target = Vec3::reflect(ray.direction, normal);
+            result.ray = Ray(position, Vec3::normalize(target));
+            result.color = albedo;
+            result.pdf = 0.0;
+            result.is_specular = true;
+            result.did_scatter = true;
+            break;
+        }
+        case MATERIAL_LIGHT:
+            result.did_scatter = false;
+            break;
+    }
 
     return result;
 }
 
-Vec3 LambertianMaterial::emitted(const Vec3 &p) {
-    return Vec3(0.0, 0.0, 0.0);
+Vec3 Material::eval(const Vec3 &albedo, const Ray &ray, const Vec3 &direction, const Vec3 &normal) const {
+    if (type != MATERIAL_LAMBERTIAN) {
+        return Vec3(0.0, 0.0, 0.0);
+    }
+    return pdf(ray, direction, normal) * albedo;
 }
 
-ScatterResult MetalMaterial::scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord) {
-    ScatterResult result;
-
-    Vec3 target = Vec3::reflect(ray.direction, normal);
-    result.ray = Ray(position, Vec3::normalize(target)); 
-    result.color = albedo->value(texture_coord, position);
-    result.did_scatter = true;
-
-    return result;
-}
-
-Vec3 MetalMaterial::emitted(const Vec3 &p) {
-    return Vec3(0.0, 0.0, 0.0);
-}
-
-ScatterResult DiffuseLightMaterial::scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord) {
-    ScatterResult result;
-    result.did_scatter = false;
-    return result;
-}
+float Material::pdf(const Ray &, const Vec3 &direction, const Vec3 &normal) const {
+    if (type != MATERIAL_LAMBERTIAN) {
+        return 0.0;
+    }
 
-Vec3 DiffuseLightMaterial::emitted(const Vec3 &p) {
-    return albedo->value(Vec2(0.0, 0.0), p);
+    float cos_theta = Vec3::dot(direction, normal);
+    return cos_theta > 0.0 ? cos_theta / M_PI : 0.0;
 }
@@ -3,51 +3,54 @@
 #include "vec3.h"
 #include "texture.h"
 #include "ray.h"
+#include "sampler.h"
 
 struct ScatterResult {
     bool did_scatter;
     Ray ray;
     Vec3 color;
+    // Solid angle density of ray.direction, unused for specular scattering.
+    float pdf;
+    bool is_specular;
 };
 
-class Material {
-    public:
-        virtual ScatterResult scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord) = 0; 
-        virtual Vec3 emitted(const Vec3 &p) = 0;
-};
-
-class LambertianMaterial : public Material {
-    public:
-        Texture *albedo; 
-
-        LambertianMaterial(Texture *albedo) { 
-            this->albedo = albedo;
-        };
-
-        ScatterResult scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord);
-        Vec3 emitted(const Vec3 &p);
+enum MaterialType {
+    MATERIAL_LAMBERTIAN,
+    MATERIAL_METAL,
+    MATERIAL_LIGHT
 };
 
-class MetalMaterial : public Material {
+// A material is its type and a texture, the albedo of surfaces that scatter
+// and the radiance of lights. Rendering doesn't evaluate the texture through
+// the material but through the scene's ShadingGraph, at albedo_node, and
+// passes the result to the functions here, which pick the type's BSDF with
+// a switch rather than a virtual call.
+class Material {
     public:
+        MaterialType type;
         Texture *albedo;
+        // Set when a ShadingGraph is compiled from the material. Until then
+        // it is node 0, which is black in every graph, so that looking up a
+        // material the graph was not compiled from never reads outside it.
+        int albedo_node;
 
-        MetalMaterial(Texture *albedo) {
+        Material(MaterialType type, Texture *albedo) {
+            this->type = type;
             this->albedo = albedo;
+            this->albedo_node = 0;
         };
 
-        ScatterResult scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord);
-        Vec3 emitted(const Vec3 &p);
-};
-
-class DiffuseLightMaterial : public Material {
-    public:
-        Texture *albedo;
+        virtual ~Material() { };
 
-        DiffuseLightMaterial(Texture *albedo) {
-            this->albedo = albedo;
+        bool is_emissive() const {
+            return type == MATERIAL_LIGHT;
         };
 
-        ScatterResult scatter(const Ray &ray, const Vec3 &position, const Vec3 &normal, const Vec2 &texture_coord);
-        Vec3 emitted(const Vec3 &p);
+        ScatterResult scatter(const Vec3 &albedo, const Ray &ray, const Vec3 &position, const Vec3 &normal, Sampler &sampler) const;
+
+        // BSDF times cosine for light leaving along -ray.direction that
+        // arrives from direction, and the density scatter() has of picking
+        // direction. Only called for materials that scatter non-specularly.
+        Vec3 eval(const Vec3 &albedo, const Ray &ray, const Vec3 &direction, const Vec3 &normal) const;
+        float pdf(const Ray &ray, const Vec3 &direction, const Vec3 &normal) const;
 };
@@ -0,0 +1,122 @@
+#include "matrix.h"
+
+Matrix3x4::Matrix3x4() {
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            columns[j][i] = i == j && i < 3 ? 1.0 : 0.0;
+        }
+    }
+}
+
+Matrix3x4 Matrix3x4::translate(const Vec3 &translation) {
+    Matrix3x4 result;
+    result.columns[3][0] = translation.x;
+    result.columns[3][1] = translation.y;
+    result.columns[3][2] = translation.z;
+    return result;
+}
+
+Matrix3x4 Matrix3x4::rotate_x(float angle) {
+    Matrix3x4 result;
+    float c = cos(angle), s = sin(angle);
+    result.columns[1][1] = c;
+    result.columns[2][1] = -s;
+    result.columns[1][2] = s;
+    result.columns[2][2] = c;
+    return result;
+}
+
+Matrix3x4 Matrix3x4::rotate_y(float angle) {
+    Matrix3x4 result;
+    float c = cos(angle), s = sin(angle);
+    result.columns[0][0] = c;
+    result.columns[2][0] = s;
+    result.columns[0][2] = -s;
+    result.columns[2][2] = c;
+    return result;
+}
+
+Matrix3x4 Matrix3x4::rotate_z(float angle) {
+    Matrix3x4 result;
+    float c = cos(angle), s = sin(angle);
+    result.columns[0][0] = c;
+    result.columns[1][0] = -s;
+    result.columns[0][1] = s;
+    result.columns[1][1] = c;
+    return result;
+}
+
+Matrix3x4 Matrix3x4::scale(const Vec3 &scale) {
+    Matrix3x4 result;
+    result.columns[0][0] = scale.x;
+    result.columns[1][1] = scale.y;
+    result.columns[2][2] = scale.z;
+    return result;
+}
+
+// The linear part is inverted through its cofactors, in double precision so
+// that a transform and its inverse round trip closely, and the translation
+// is undone afterwards.
+Matrix3x4 Matrix3x4::inverse() const {
+    double a[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            a[i][j] = columns[j][i];
+        }
+    }
+
+    double cofactors[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            int i0 = (i + 1) % 3, i1 = (i + 2) % 3;
+            int j0 = (j + 1) % 3, j1 = (j + 2) % 3;
+            cofactors[i][j] = a[i0][j0] * a[i1][j1] - a[i0][j1] * a[i1][j0];
+        }
+    }
+
+    double determinant = a[0][0] * cofactors[0][0] + a[0][1] * cofactors[0][1] + a[0][2] * cofactors[0][2];
+    Matrix3x4 result;
+
+    if (determinant == 0.0) {
+        return result;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        double t = 0.0;
+
+        for (int j = 0; j < 3; j++) {
+            result.columns[j][i] = cofactors[j][i] / determinant;
+            t -= (cofactors[j][i] / determinant) * columns[3][j];
+        }
+
+        result.columns[3][i] = t;
+    }
+
+    return result;
+}
+
+Matrix3x4 Matrix3x4::normal_matrix() const {
+    Matrix3x4 inverse_matrix = inverse();
+    Matrix3x4 result;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            result.columns[j][i] = inverse_matrix.columns[i][j];
+        }
+    }
+
+    return result;
+}
+
+Matrix3x4 operator*(const Matrix3x4 &a, const Matrix3x4 &b) {
+    Matrix3x4 result;
+
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 3; i++) {
+            float sum = a.columns[0][i] * b.columns[j][0] + a.columns[1][i] * b.columns[j][1] + a.columns[2][i] * b.columns[j][2];
+            result.columns[j][i] = j == 3 ? sum + a.columns[3][i] : sum;
+        }
+    }
+
+    return result;
+}
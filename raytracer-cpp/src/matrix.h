@@ -0,0 +1,62 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "ray.h"
+#include "vec3.h"
+
+// An affine transform, the top three rows of a 4x4 matrix whose last row is
+// 0 0 0 1. Points are transformed as m * (x, y, z, 1) and vectors as
+// m * (x, y, z, 0). The matrix is stored by columns, each padded to four
+// floats, so that transforming is a sum of columns scaled by broadcast
+// coordinates.
+class alignas(16) Matrix3x4 {
+    public:
+        // columns[j][i] is the element in row i and column j, and
+        // columns[j][3] is always zero.
+        float columns[4][4];
+
+        Matrix3x4();
+
+        static Matrix3x4 translate(const Vec3 &translation);
+        static Matrix3x4 rotate_x(float angle);
+        static Matrix3x4 rotate_y(float angle);
+        static Matrix3x4 rotate_z(float angle);
+        static Matrix3x4 scale(const Vec3 &scale);
+
+        // Returns the identity for a singular matrix.
+        Matrix3x4 inverse() const;
+
+        // The inverse transpose of the linear part, which carries normals
+        // to surfaces under this transform. Normals come out unnormalized
+        // unless the transform is rigid.
+        Matrix3x4 normal_matrix() const;
+
+        // Inline since rays are transformed this way at every instance.
+        Vec3 transform_point(const Vec3 &p) const {
+            float result[4];
+            _mm_store_ps(result, _mm_add_ps(linear(p), _mm_load_ps(columns[3])));
+            return Vec3(result[0], result[1], result[2]);
+        };
+
+        Vec3 transform_vector(const Vec3 &v) const {
+            float result[4];
+            _mm_store_ps(result, linear(v));
+            return Vec3(result[0], result[1], result[2]);
+        };
+
+        Ray transform_ray(const Ray &ray) const {
+            return Ray(transform_point(ray.origin), transform_vector(ray.direction));
+        };
+
+    private:
+        __m128 linear(const Vec3 &v) const {
+            __m128 x = _mm_mul_ps(_mm_load_ps(columns[0]), _mm_set1_ps(v.x));
+            __m128 y = _mm_mul_ps(_mm_load_ps(columns[1]), _mm_set1_ps(v.y));
+            __m128 z = _mm_mul_ps(_mm_load_ps(columns[2]), _mm_set1_ps(v.z));
+            return _mm_add_ps(_mm_add_ps(x, y), z);
+        };
+};
+
+// The transform applying b first and then a.
+Matrix3x4 operator*(const Matrix3x4 &a, const Matrix3x4 &b);
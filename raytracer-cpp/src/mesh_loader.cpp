@@ -0,0 +1,624 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include "mesh_loader.h"
+#include "text_reader.h"
+
+bool load_mesh(const char *path, TriangleMesh &mesh) {
+    const char *extension = strrchr(path, '.');
+    bool loaded;
+
+    if (extension && strcasecmp(extension, ".obj") == 0) {
+        loaded = load_obj(path, mesh);
+    }
+    else if (extension && strcasecmp(extension, ".ply") == 0) {
+        loaded = load_ply(path, mesh);
+    }
+    else {
+        fprintf(stderr, "Unknown mesh format for '%s', expected .obj or .ply\n", path);
+        return false;
+    }
+
+    if (loaded) {
+        mesh.build();
+    }
+    return loaded;
+}
+
+// One corner of an OBJ face, zero-based, with -1 for a missing index.
+struct ObjCorner {
+    int position, texture_coord, normal;
+
+    bool operator==(const ObjCorner &other) const {
+        return position == other.position && texture_coord == other.texture_coord && normal == other.normal;
+    };
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner &corner) const {
+        uint64_t h = (uint32_t) corner.position;
+        h = h * 0x9e3779b97f4a7c15ull + (uint32_t) corner.texture_coord;
+        h = h * 0x9e3779b97f4a7c15ull + (uint32_t) corner.normal;
+        return h ^ (h >> 29);
+    };
+};
+
+// Reads a one-based or negative OBJ index at p, leaving p after it.
+static bool parse_obj_index(const char *&p, int count, int &index) {
+    bool negative = *p == '-';
+    if (negative) {
+        p++;
+    }
+
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+
+    long long value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = 10 * value + (*p++ - '0');
+        if (value > INT32_MAX) {
+            return false;
+        }
+    }
+
+    index = negative ? count - value : value - 1;
+    return index >= 0 && index < count;
+}
+
+class ObjParser {
+    private:
+        const char *path;
+        LineReader reader;
+
+        std::vector<Vec3> file_positions, file_normals;
+        std::vector<Vec2> file_texture_coords;
+
+        // Mesh vertices for corners with only a position, and for corners
+        // with other indices as well.
+        std::vector<int> position_vertices;
+        std::unordered_map<ObjCorner, int, ObjCornerHash> corner_vertices;
+        std::vector<ObjCorner> vertex_corners;
+        std::vector<int> face;
+        bool all_normals, all_texture_coords;
+
+        bool error(const char *format, ...);
+        bool read_floats(char *&line, float *values, int min_count, int max_count);
+        int vertex(const ObjCorner &corner);
+        bool parse_face(char *line);
+
+    public:
+        TriangleMesh &mesh;
+
+        ObjParser(FILE *file, const char *path, TriangleMesh &mesh) : reader(file), mesh(mesh) {
+            this->path = path;
+            this->all_normals = true;
+            this->all_texture_coords = true;
+        };
+
+        bool parse();
+};
+
+bool ObjParser::error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: ", path, reader.line_number);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    return false;
+}
+
+bool ObjParser::read_floats(char *&line, float *values, int min_count, int max_count) {
+    for (int i = 0; i < max_count; i++) {
+        char *token = next_token(line);
+
+        if (!token) {
+            return i >= min_count || error("expected more numbers");
+        }
+        if (!parse_float(token, values[i])) {
+            return error("expected a number instead of '%s'", token);
+        }
+    }
+
+    return true;
+}
+
+int ObjParser::vertex(const ObjCorner &corner) {
+    if (corner.texture_coord < 0 && corner.normal < 0) {
+        if ((int) position_vertices.size() < (int) file_positions.size()) {
+            position_vertices.resize(file_positions.size(), -1);
+        }
+
+        int &index = position_vertices[corner.position];
+        if (index < 0) {
+            index = vertex_corners.size();
+            vertex_corners.push_back(corner);
+        }
+        return index;
+    }
+
+    auto inserted = corner_vertices.insert(std::make_pair(corner, (int) vertex_corners.size()));
+    if (inserted.second) {
+        vertex_corners.push_back(corner);
+    }
+    return inserted.first->second;
+}
+
+bool ObjParser::parse_face(char *line) {
+    face.clear();
+
+    while (char *token = next_token(line)) {
+        const char *p = token;
+        ObjCorner corner = { -1, -1, -1 };
+
+        if (!parse_obj_index(p, file_positions.size(), corner.position)) {
+            return error("bad vertex index in '%s'", token);
+        }
+        if (*p == '/') {
+            p++;
+            if (*p != '/' && !parse_obj_index(p, file_texture_coords.size(), corner.texture_coord)) {
+                return error("bad texture coordinate index in '%s'", token);
+            }
+            if (*p == '/') {
+                p++;
+                if (!parse_obj_index(p, file_normals.size(), corner.normal)) {
+                    return error("bad normal index in '%s'", token);
+                }
+            }
+        }
+        if (*p != '\0') {
+            return error("bad face vertex '%s'", token);
+        }
+
+        all_texture_coords = all_texture_coords && corner.texture_coord >= 0;
+        all_normals = all_normals && corner.normal >= 0;
+        face.push_back(vertex(corner));
+    }
+
+    if (face.size() < 3) {
+        return error("face with fewer than three vertices");
+    }
+
+    for (size_t i = 2; i < face.size(); i++) {
+        mesh.indices.push_back(face[0]);
+        mesh.indices.push_back(face[i - 1]);
+        mesh.indices.push_back(face[i]);
+    }
+
+    return true;
+}
+
+bool ObjParser::parse() {
+    while (char *line = reader.next_line()) {
+        char *keyword = next_token(line);
+        float values[3];
+
+        if (!keyword) {
+            continue;
+        }
+
+        if (strcmp(keyword, "v") == 0) {
+            if (!read_floats(line, values, 3, 3)) {
+                return false;
+            }
+            file_positions.push_back(Vec3(values[0], values[1], values[2]));
+        }
+        else if (strcmp(keyword, "f") == 0) {
+            if (!parse_face(line)) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "vn") == 0) {
+            if (!read_floats(line, values, 3, 3)) {
+                return false;
+            }
+            file_normals.push_back(Vec3(values[0], values[1], values[2]));
+        }
+        else if (strcmp(keyword, "vt") == 0) {
+            values[1] = 0.0;
+            if (!read_floats(line, values, 1, 2)) {
+                return false;
+            }
+            file_texture_coords.push_back(Vec2(values[0], values[1]));
+        }
+    }
+
+    if (reader.failed()) {
+        return error("could not read the file");
+    }
+
+    mesh.positions.resize(vertex_corners.size());
+    for (size_t i = 0; i < vertex_corners.size(); i++) {
+        mesh.positions[i] = file_positions[vertex_corners[i].position];
+    }
+
+    if (all_normals && !mesh.indices.empty()) {
+        mesh.normals.resize(vertex_corners.size());
+        for (size_t i = 0; i < vertex_corners.size(); i++) {
+            mesh.normals[i] = file_normals[vertex_corners[i].normal];
+        }
+    }
+
+    if (all_texture_coords && !mesh.indices.empty()) {
+        mesh.texture_coords.resize(vertex_corners.size());
+        for (size_t i = 0; i < vertex_corners.size(); i++) {
+            mesh.texture_coords[i] = file_texture_coords[vertex_corners[i].texture_coord];
+        }
+    }
+
+    return true;
+}
+
+bool load_obj(const char *path, TriangleMesh &mesh) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open mesh '%s'\n", path);
+        return false;
+    }
+
+    ObjParser parser(file, path, mesh);
+    bool loaded = parser.parse();
+    fclose(file);
+    return loaded;
+}
+
+enum PlyType {
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64,
+    PLY_NONE
+};
+
+static const int ply_type_sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+static PlyType parse_ply_type(const char *name) {
+    const char *names[][2] = {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+    };
+
+    for (int i = 0; i < PLY_NONE; i++) {
+        if (strcmp(name, names[i][0]) == 0 || strcmp(name, names[i][1]) == 0) {
+            return (PlyType) i;
+        }
+    }
+    return PLY_NONE;
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type;
+    // The type of the element count for list properties, PLY_NONE otherwise.
+    PlyType count_type;
+};
+
+struct PlyElement {
+    std::string name;
+    long long count;
+    std::vector<PlyProperty> properties;
+};
+
+// Reads PLY values out of the body, swapping bytes when the file's order
+// is not the machine's.
+class PlyReader {
+    public:
+        const unsigned char *p, *end;
+        bool swap;
+
+        bool read(PlyType type, double &value);
+};
+
+bool PlyReader::read(PlyType type, double &value) {
+    int size = ply_type_sizes[type];
+    unsigned char bytes[8];
+
+    if (end - p < size) {
+        return false;
+    }
+
+    for (int i = 0; i < size; i++) {
+        bytes[i] = p[swap ? size - 1 - i : i];
+    }
+    p += size;
+
+    switch (type) {
+        case PLY_INT8: { int8_t v; memcpy(&v, bytes, 1); value = v; break; }
+        case PLY_UINT8: { uint8_t v; memcpy(&v, bytes, 1); value = v; break; }
+        case PLY_INT16: { int16_t v; memcpy(&v, bytes, 2); value = v; break; }
+        case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, 2); value = v; break; }
+        case PLY_INT32: { int32_t v; memcpy(&v, bytes, 4); value = v; break; }
+        case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, 4); value = v; break; }
+        case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); value = v; break; }
+        default: { double v; memcpy(&v, bytes, 8); value = v; break; }
+    }
+    return true;
+}
+
+static bool read_ply_header(FILE *file, const char *path, bool &big_endian, std::vector<PlyElement> &elements) {
+    char line[1024];
+
+    if (!fgets(line, sizeof(line), file) || strncmp(line, "ply", 3) != 0) {
+        fprintf(stderr, "'%s' is not a PLY file\n", path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *p = line;
+        char *keyword = next_token(p);
+
+        if (!keyword || strcmp(keyword, "comment") == 0 || strcmp(keyword, "obj_info") == 0) {
+            continue;
+        }
+        else if (strcmp(keyword, "end_header") == 0) {
+            return true;
+        }
+        else if (strcmp(keyword, "format") == 0) {
+            char *format = next_token(p);
+
+            if (format && strcmp(format, "binary_little_endian") == 0) {
+                big_endian = false;
+            }
+            else if (format && strcmp(format, "binary_big_endian") == 0) {
+                big_endian = true;
+            }
+            else {
+                fprintf(stderr, "'%s' is not a binary PLY file\n", path);
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "element") == 0) {
+            char *name = next_token(p);
+            char *count = next_token(p);
+
+            if (!name || !count) {
+                break;
+            }
+            elements.push_back(PlyElement());
+            elements.back().name = name;
+            elements.back().count = atoll(count);
+        }
+        else if (strcmp(keyword, "property") == 0 && !elements.empty()) {
+            PlyProperty property;
+            char *type = next_token(p);
+
+            if (type && strcmp(type, "list") == 0) {
+                char *count_type = next_token(p);
+                type = next_token(p);
+                property.count_type = count_type ? parse_ply_type(count_type) : PLY_NONE;
+
+                if (property.count_type == PLY_NONE) {
+                    break;
+                }
+            }
+            else {
+                property.count_type = PLY_NONE;
+            }
+
+            char *name = next_token(p);
+            property.type = type ? parse_ply_type(type) : PLY_NONE;
+            if (property.type == PLY_NONE || !name) {
+                break;
+            }
+            property.name = name;
+            elements.back().properties.push_back(property);
+        }
+        else {
+            break;
+        }
+    }
+
+    fprintf(stderr, "Bad PLY header in '%s'\n", path);
+    return false;
+}
+
+static int find_ply_property(const PlyElement &element, const char *name, const char *other_name) {
+    for (size_t i = 0; i < element.properties.size(); i++) {
+        const std::string &property = element.properties[i].name;
+
+        if (property == name || (other_name && property == other_name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool read_ply_vertices(PlyReader &reader, const PlyElement &element, TriangleMesh &mesh) {
+    const char *names[8][2] = {
+        { "x", nullptr }, { "y", nullptr }, { "z", nullptr },
+        { "nx", nullptr }, { "ny", nullptr }, { "nz", nullptr },
+        { "u", "s" }, { "v", "t" }
+    };
+
+    // Which of the values above each property holds, -1 for none.
+    std::vector<int> slots(element.properties.size(), -1);
+    bool found[8];
+    for (int i = 0; i < 8; i++) {
+        int property = find_ply_property(element, names[i][0], names[i][1]);
+        found[i] = property >= 0 && element.properties[property].count_type == PLY_NONE;
+        if (found[i]) {
+            slots[property] = i;
+        }
+    }
+
+    if (!found[0] || !found[1] || !found[2]) {
+        return false;
+    }
+
+    bool has_normals = found[3] && found[4] && found[5];
+    bool has_texture_coords = found[6] && found[7];
+
+    mesh.positions.resize(element.count);
+    if (has_normals) {
+        mesh.normals.resize(element.count);
+    }
+    if (has_texture_coords) {
+        mesh.texture_coords.resize(element.count);
+    }
+
+    for (long long i = 0; i < element.count; i++) {
+        double values[8] = { 0.0 };
+
+        for (size_t j = 0; j < element.properties.size(); j++) {
+            const PlyProperty &property = element.properties[j];
+            double value, count;
+
+            if (property.count_type != PLY_NONE) {
+                if (!reader.read(property.count_type, count)) {
+                    return false;
+                }
+                for (int k = 0; k < (int) count; k++) {
+                    if (!reader.read(property.type, value)) {
+                        return false;
+                    }
+                }
+            }
+            else if (!reader.read(property.type, value)) {
+                return false;
+            }
+            else if (slots[j] >= 0) {
+                values[slots[j]] = value;
+            }
+        }
+
+        mesh.positions[i] = Vec3(values[0], values[1], values[2]);
+        if (has_normals) {
+            mesh.normals[i] = Vec3(values[3], values[4], values[5]);
+        }
+        if (has_texture_coords) {
+            mesh.texture_coords[i] = Vec2(values[6], values[7]);
+        }
+    }
+
+    return true;
+}
+
+static bool read_ply_faces(PlyReader &reader, const PlyElement &element, TriangleMesh &mesh) {
+    int indices_property = find_ply_property(element, "vertex_indices", "vertex_index");
+    int num_vertices = mesh.positions.size();
+    std::vector<int> face;
+
+    if (indices_property < 0 || element.properties[indices_property].count_type == PLY_NONE) {
+        return false;
+    }
+
+    mesh.indices.reserve(3 * element.count);
+
+    for (long long i = 0; i < element.count; i++) {
+        for (size_t j = 0; j < element.properties.size(); j++) {
+            const PlyProperty &property = element.properties[j];
+            double value, count = 1.0;
+
+            if (property.count_type != PLY_NONE && !reader.read(property.count_type, count)) {
+                return false;
+            }
+
+            face.clear();
+            for (int k = 0; k < (int) count; k++) {
+                if (!reader.read(property.type, value)) {
+                    return false;
+                }
+                if ((int) j == indices_property) {
+                    if (value < 0 || value >= num_vertices) {
+                        return false;
+                    }
+                    face.push_back((int) value);
+                }
+            }
+
+            for (size_t k = 2; k < face.size(); k++) {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[k - 1]);
+                mesh.indices.push_back(face[k]);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool load_ply(const char *path, TriangleMesh &mesh) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open mesh '%s'\n", path);
+        return false;
+    }
+
+    bool big_endian = false;
+    std::vector<PlyElement> elements;
+
+    if (!read_ply_header(file, path, big_endian, elements)) {
+        fclose(file);
+        return false;
+    }
+
+    long body_start = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long body_size = ftell(file) - body_start;
+    fseek(file, body_start, SEEK_SET);
+
+    std::vector<unsigned char> body(body_size > 0 ? body_size : 1);
+    bool read = fread(&body[0], 1, body_size, file) == (size_t) body_size;
+    fclose(file);
+
+    if (!read) {
+        fprintf(stderr, "Could not read '%s'\n", path);
+        return false;
+    }
+
+    const uint16_t one = 1;
+    bool machine_is_big_endian = *(const unsigned char*) &one == 0;
+
+    PlyReader reader;
+    reader.p = &body[0];
+    reader.end = &body[0] + body_size;
+    reader.swap = big_endian != machine_is_big_endian;
+
+    bool has_vertices = false;
+
+    for (const PlyElement &element : elements) {
+        bool loaded;
+
+        if (element.name == "vertex") {
+            loaded = read_ply_vertices(reader, element, mesh);
+            has_vertices = loaded;
+        }
+        else if (element.name == "face") {
+            loaded = has_vertices && read_ply_faces(reader, element, mesh);
+        }
+        else {
+            // Elements the mesh has no use for still have to be read past.
+            loaded = true;
+            for (long long i = 0; i < element.count && loaded; i++) {
+                for (const PlyProperty &property : element.properties) {
+                    double value, count = 1.0;
+
+                    if (property.count_type != PLY_NONE && !reader.read(property.count_type, count)) {
+                        loaded = false;
+                        break;
+                    }
+                    for (int k = 0; k < (int) count && loaded; k++) {
+                        loaded = reader.read(property.type, value);
+                    }
+                }
+            }
+        }
+
+        if (!loaded) {
+            fprintf(stderr, "Bad or truncated '%s' element in '%s'\n", element.name.c_str(), path);
+            return false;
+        }
+    }
+
+    return true;
+}
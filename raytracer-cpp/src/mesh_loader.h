@@ -0,0 +1,20 @@
+#pragma once
+
+#include "triangle_mesh.h"
+
+// Reads a mesh into an empty TriangleMesh and builds its BVH, picking the
+// loader by extension. Returns false after printing the reason if the file
+// cannot be read, leaving the mesh partly filled in.
+bool load_mesh(const char *path, TriangleMesh &mesh);
+
+// Wavefront OBJ: v, vt, vn and f statements, with polygons split into fans
+// and negative indices counted back from the end. Vertices are shared
+// between faces wherever they use the same combination of indices. Normals
+// and texture coordinates are only kept if every face has them, and
+// everything else, materials and groups included, is skipped.
+bool load_obj(const char *path, TriangleMesh &mesh);
+
+// Binary PLY, either byte order, with x, y, z and optionally nx, ny, nz and
+// u, v (or s, t) vertex properties of any scalar type and a face list of
+// vertex indices. ASCII PLY is not read.
+bool load_ply(const char *path, TriangleMesh &mesh);
@@ -15,3 +15,10 @@ class Ray {
 
         Vec3 point_at_time(float t) const;
 };
+
+// How a camera ray's direction changes from one pixel to the next, across
+// and down the image. Both rays of a pixel step share its origin.
+class RayDifferential {
+    public:
+        Vec3 dx_direction, dy_direction;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ray.h"
+#include "simd.h"
+
+// A bundle of rays stored both as individual rays and transposed into SIMD
+// registers. Packets are only worth tracing together while their rays are
+// coherent, callers fall back to the individual rays otherwise.
+template <class FloatN>
+class RayPacket {
+    public:
+        static const int width = FloatN::width;
+
+        Ray rays[FloatN::width];
+        FloatN origin_x, origin_y, origin_z;
+        FloatN direction_x, direction_y, direction_z;
+
+        RayPacket() { };
+
+        RayPacket(const Ray *rays) {
+            float ox[width], oy[width], oz[width];
+            float dx[width], dy[width], dz[width];
+
+            for (int i = 0; i < width; i++) {
+                this->rays[i] = rays[i];
+                ox[i] = rays[i].origin.x;
+                oy[i] = rays[i].origin.y;
+                oz[i] = rays[i].origin.z;
+                dx[i] = rays[i].direction.x;
+                dy[i] = rays[i].direction.y;
+                dz[i] = rays[i].direction.z;
+            }
+
+            origin_x = FloatN::load(ox);
+            origin_y = FloatN::load(oy);
+            origin_z = FloatN::load(oz);
+            direction_x = FloatN::load(dx);
+            direction_y = FloatN::load(dy);
+            direction_z = FloatN::load(dz);
+        };
+
+        // True when every ray has the same direction signs, so one
+        // front-to-back order through a BVH suits all of them.
+        bool is_coherent() const {
+            int x = (direction_x < FloatN(0.0f)).mask();
+            int y = (direction_y < FloatN(0.0f)).mask();
+            int z = (direction_z < FloatN(0.0f)).mask();
+            int all = (1 << width) - 1;
+
+            return (x == 0 || x == all) && (y == 0 || y == all) && (z == 0 || z == all);
+        };
+};
+
+typedef RayPacket<Float4> RayPacket4;
+typedef RayPacket<Float8> RayPacket8;
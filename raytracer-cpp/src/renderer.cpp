@@ -0,0 +1,191 @@
+#include <cfloat>
+#include <chrono>
+#include <thread>
+
+#include "renderer.h"
+
+TileScheduler::TileScheduler(int width, int height, int tile_size, int num_workers) {
+    for (int i = 0; i < num_workers; i++) {
+        queues.push_back(std::unique_ptr<TileQueue>(new TileQueue()));
+    }
+
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+    int num_tiles = tiles_x * tiles_y;
+
+    // Hand out contiguous runs of tiles so that each worker starts with a
+    // coherent region of the image.
+    for (int i = 0; i < num_tiles; i++) {
+        int x0 = (i % tiles_x) * tile_size;
+        int y0 = (i / tiles_x) * tile_size;
+        int x1 = x0 + tile_size < width ? x0 + tile_size : width;
+        int y1 = y0 + tile_size < height ? y0 + tile_size : height;
+
+        int worker = (int) (((long long) i * num_workers) / num_tiles);
+        queues[worker]->tiles.push_back(Tile(x0, y0, x1, y1));
+    }
+}
+
+bool TileScheduler::next_tile(int worker, Tile &tile) {
+    {
+        TileQueue &queue = *queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (!queue.tiles.empty()) {
+            tile = queue.tiles.front();
+            queue.tiles.pop_front();
+            return true;
+        }
+    }
+
+    int num_workers = queues.size();
+
+    for (int i = 1; i < num_workers; i++) {
+        TileQueue &victim = *queues[(worker + i) % num_workers];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tiles.empty()) {
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void render_tiles(int width, int height, int tile_size, int num_threads,
+                  const std::function<void(const Tile &tile, int thread_index)> &render_tile) {
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    TileScheduler scheduler(width, height, tile_size, num_threads);
+
+    auto worker = [&](int thread_index) {
+        Tile tile;
+
+        while (scheduler.next_tile(thread_index, tile)) {
+            render_tile(tile, thread_index);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++) {
+        threads.push_back(std::thread(worker, i));
+    }
+
+    worker(0);
+
+    for (int i = 0; i < (int) threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+void PixelEstimate::add(const Vec3 &color) {
+    num_samples++;
+    mean = mean + (1.0 / num_samples) * (color - mean);
+
+    float luminance = Vec3::luminance(color);
+    float delta = luminance - luminance_mean;
+    luminance_mean += delta / num_samples;
+    luminance_m2 += delta * (luminance - luminance_mean);
+}
+
+float PixelEstimate::error() const {
+    if (num_samples < 2) {
+        return FLT_MAX;
+    }
+
+    float variance = luminance_m2 / (num_samples - 1);
+    return 1.96 * sqrt(variance / num_samples) / sqrtf(fmaxf(luminance_mean, 0.0001));
+}
+
+int render_adaptive(int width, int height, int tile_size, int num_threads, const AdaptiveSettings &settings,
+                    std::vector<PixelEstimate> &pixels,
+                    const std::function<Vec3(int x, int y, int sample_index, int thread_index)> &render_sample) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    size_t num_pixels = (size_t) width * height;
+    pixels.assign(num_pixels, PixelEstimate());
+    std::vector<char> noisy(num_pixels), active(num_pixels, 1);
+    int num_passes = 0;
+
+    while (true) {
+        int batch_size = num_passes == 0 ? settings.min_samples : settings.batch_size;
+
+        render_tiles(width, height, tile_size, num_threads, [&](const Tile &tile, int thread_index) {
+            for (int y = tile.y0; y < tile.y1; y++) {
+                for (int x = tile.x0; x < tile.x1; x++) {
+                    PixelEstimate &pixel = pixels[(size_t) y * width + x];
+
+                    if (!active[(size_t) y * width + x]) {
+                        continue;
+                    }
+
+                    for (int k = 0; k < batch_size && pixel.num_samples < settings.max_samples; k++) {
+                        pixel.add(render_sample(x, y, pixel.num_samples, thread_index));
+                    }
+                }
+            }
+        });
+        num_passes++;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        if (settings.time_budget > 0.0 && elapsed >= settings.time_budget) {
+            break;
+        }
+
+        float threshold = settings.noise_target;
+        if (threshold <= 0.0) {
+            double total_error = 0.0;
+            int num_open = 0;
+
+            for (size_t i = 0; i < num_pixels; i++) {
+                if (pixels[i].num_samples < settings.max_samples) {
+                    total_error += fminf(pixels[i].error(), 1.0);
+                    num_open++;
+                }
+            }
+
+            threshold = num_open > 0 ? total_error / num_open : 0.0;
+        }
+
+        for (size_t i = 0; i < num_pixels; i++) {
+            noisy[i] = pixels[i].num_samples < settings.max_samples && pixels[i].error() > threshold;
+        }
+
+        // Neighbours of noisy pixels keep sampling too, since a few samples
+        // can easily all miss a small bright feature.
+        bool any_active = false;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t i = (size_t) y * width + x;
+                active[i] = 0;
+
+                if (pixels[i].num_samples >= settings.max_samples) {
+                    continue;
+                }
+
+                for (int dy = -1; dy <= 1 && !active[i]; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx, ny = y + dy;
+
+                        if (nx >= 0 && nx < width && ny >= 0 && ny < height && noisy[(size_t) ny * width + nx]) {
+                            active[i] = 1;
+                            break;
+                        }
+                    }
+                }
+
+                any_active = any_active || active[i];
+            }
+        }
+
+        if (!any_active) {
+            break;
+        }
+    }
+
+    return num_passes;
+}
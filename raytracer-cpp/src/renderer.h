@@ -0,0 +1,95 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "vec3.h"
+
+class Tile {
+    public:
+        int x0, y0, x1, y1;
+
+        Tile() { };
+
+        Tile(int x0, int y0, int x1, int y1) {
+            this->x0 = x0;
+            this->y0 = y0;
+            this->x1 = x1;
+            this->y1 = y1;
+        };
+};
+
+class TileQueue {
+    public:
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+};
+
+// Each worker owns a queue of neighbouring tiles and takes work from its
+// front. A worker whose queue runs dry steals from the back of another
+// worker's queue, so the tiles it takes are the ones furthest away from
+// where the victim is currently rendering.
+class TileScheduler {
+    private:
+        std::vector<std::unique_ptr<TileQueue>> queues;
+
+    public:
+        TileScheduler(int width, int height, int tile_size, int num_workers);
+
+        bool next_tile(int worker, Tile &tile);
+};
+
+void render_tiles(int width, int height, int tile_size, int num_threads,
+                  const std::function<void(const Tile &tile, int thread_index)> &render_tile);
+
+// Running mean of a pixel's samples and variance of their luminance,
+// updated with Welford's algorithm.
+class PixelEstimate {
+    public:
+        Vec3 mean;
+        float luminance_mean, luminance_m2;
+        int num_samples;
+
+        PixelEstimate() {
+            this->luminance_mean = 0.0;
+            this->luminance_m2 = 0.0;
+            this->num_samples = 0;
+        };
+
+        void add(const Vec3 &color);
+
+        // Half width of the 95% confidence interval of the luminance,
+        // divided by the square root of the luminance. That is close to
+        // the error left once the sqrt gamma the image is written with is
+        // applied, so dark pixels are not oversampled.
+        float error() const;
+};
+
+class AdaptiveSettings {
+    public:
+        int min_samples, max_samples, batch_size;
+        // Pixels stop once their error() is below noise_target. With
+        // no target, every pass samples the pixels noisier than average.
+        float noise_target;
+        // Seconds after which no new pass is started, 0 for no limit.
+        double time_budget;
+
+        AdaptiveSettings() {
+            this->min_samples = 16;
+            this->max_samples = 256;
+            this->batch_size = 8;
+            this->noise_target = 0.0;
+            this->time_budget = 0.0;
+        };
+};
+
+// Renders min_samples samples for every pixel and then passes of
+// batch_size more for the pixels that are still noisy and their
+// neighbours, until none are left, all reach max_samples or the time
+// budget runs out. Returns the number of passes.
+int render_adaptive(int width, int height, int tile_size, int num_threads, const AdaptiveSettings &settings,
+                    std::vector<PixelEstimate> &pixels,
+                    const std::function<Vec3(int x, int y, int sample_index, int thread_index)> &render_sample);
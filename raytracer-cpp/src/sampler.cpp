@@ -0,0 +1,430 @@
+#include <string.h>
+#include <vector>
+
+#include "sampler.h"
+
+void PCG32::seed(uint64_t initial_state, uint64_t sequence) {
+    state = 0;
+    inc = (sequence << 1) | 1;
+    next_uint();
+    state += initial_state;
+    next_uint();
+}
+
+// "Random Number Generation with Arbitrary Strides" (Brown 1994), as in the
+// reference implementation.
+void PCG32::advance(uint64_t delta) {
+    uint64_t multiplier = 6364136223846793005ULL, increment = inc;
+    uint64_t total_multiplier = 1, total_increment = 0;
+
+    while (delta > 0) {
+        if (delta & 1) {
+            total_multiplier *= multiplier;
+            total_increment = total_increment * multiplier + increment;
+        }
+        increment = (multiplier + 1) * increment;
+        multiplier *= multiplier;
+        delta >>= 1;
+    }
+
+    state = total_multiplier * state + total_increment;
+}
+
+uint32_t PCG32::next_uint() {
+    uint64_t old_state = state;
+    state = old_state * 6364136223846793005ULL + inc;
+    uint32_t xor_shifted = (uint32_t) (((old_state >> 18) ^ old_state) >> 27);
+    uint32_t rot = (uint32_t) (old_state >> 59);
+    return (xor_shifted >> rot) | (xor_shifted << ((-rot) & 31));
+}
+
+// Uses the top 24 bits so every float in [0, 1) with a 2^-24 spacing can
+// be produced and 1.0 never is.
+float PCG32::next_float() {
+    return (next_uint() >> 8) * (1.0f / 16777216.0f);
+}
+
+// https://zimbry.blogspot.com/2011/09/better-bit-mixing-improving-on.html
+static uint64_t mix_bits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+uint64_t hash_pixel_sample(int x, int y, int sample_index, uint64_t seed) {
+    uint64_t h = mix_bits(seed ^ 0x9e3779b97f4a7c15ULL);
+    h = mix_bits(h ^ (uint32_t) x);
+    h = mix_bits(h ^ (uint32_t) y);
+    h = mix_bits(h ^ (uint32_t) sample_index);
+    return h;
+}
+
+void RandomSampler::start_pixel_sample(int x, int y, int sample_index) {
+    rng.seed(hash_pixel_sample(x, y, sample_index, seed), seed);
+    dimension = 0;
+}
+
+float RandomSampler::next_1d() {
+    dimension++;
+    return rng.next_float();
+}
+
+Vec2 RandomSampler::next_2d() {
+    float x = rng.next_float();
+    float y = rng.next_float();
+    dimension += 2;
+    return Vec2(x, y);
+}
+
+Sampler *RandomSampler::clone() {
+    return new RandomSampler(seed);
+}
+
+int RandomSampler::current_dimension() const {
+    return dimension;
+}
+
+// Every dimension takes one number from the generator.
+void RandomSampler::skip_to_dimension(int dimension) {
+    rng.advance(dimension - this->dimension);
+    this->dimension = dimension;
+}
+
+static uint32_t hash_dimension(uint64_t h, int dimension) {
+    return (uint32_t) mix_bits(h ^ (0x632be59bd9b4e019ULL * (uint64_t) (dimension + 1)));
+}
+
+static float to_unit_float(uint32_t v) {
+    float f = v * (1.0f / 4294967296.0f);
+    return f < 0.99999994f ? f : 0.99999994f;
+}
+
+// Correlated Multi-Jittered Sampling (Kensler 2013)
+static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+
+    do {
+        i ^= p;
+        i *= 0xe170893d;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3f;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+
+    return (i + p) % l;
+}
+
+void StratifiedSampler::start_pixel_sample(int x, int y, int sample_index) {
+    this->pixel_hash = hash_pixel_sample(x, y, 0, seed);
+    this->sample_index = sample_index;
+    this->dimension = 0;
+    rng.seed(hash_pixel_sample(x, y, sample_index, seed), seed);
+}
+
+float StratifiedSampler::next_1d() {
+    // Past samples_per_pixel samples start a fresh set of strata.
+    uint32_t p = hash_dimension(pixel_hash ^ (sample_index / samples_per_pixel), dimension++);
+    uint32_t stratum = permute(sample_index % samples_per_pixel, samples_per_pixel, p);
+    return (stratum + rng.next_float()) / samples_per_pixel;
+}
+
+Vec2 StratifiedSampler::next_2d() {
+    uint32_t p = hash_dimension(pixel_hash ^ (sample_index / samples_per_pixel), dimension);
+    dimension += 2;
+
+    int n = (int) sqrtf((float) samples_per_pixel);
+    float jitter_x = rng.next_float();
+    float jitter_y = rng.next_float();
+
+    if (n * n == samples_per_pixel) {
+        uint32_t cell = permute(sample_index % samples_per_pixel, samples_per_pixel, p);
+        return Vec2(((cell % n) + jitter_x) / n, ((cell / n) + jitter_y) / n);
+    }
+
+    uint32_t stratum_x = permute(sample_index % samples_per_pixel, samples_per_pixel, p);
+    uint32_t stratum_y = permute(sample_index % samples_per_pixel, samples_per_pixel, p * 0x9e3779b9 + 1);
+    return Vec2((stratum_x + jitter_x) / samples_per_pixel, (stratum_y + jitter_y) / samples_per_pixel);
+}
+
+Sampler *StratifiedSampler::clone() {
+    return new StratifiedSampler(samples_per_pixel, seed);
+}
+
+int StratifiedSampler::current_dimension() const {
+    return dimension;
+}
+
+// Every dimension takes one number from the generator for its jitter.
+void StratifiedSampler::skip_to_dimension(int dimension) {
+    rng.advance(dimension - this->dimension);
+    this->dimension = dimension;
+}
+
+static uint32_t reverse_bits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+    v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+    v = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);
+    v = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+static uint32_t laine_karras_permutation(uint32_t v, uint32_t seed) {
+    v ^= v * 0x3d20adea;
+    v += seed;
+    v *= (seed >> 16) | 1;
+    v ^= v * 0x05526c56;
+    v ^= v * 0x53a22864;
+    return v;
+}
+
+static uint32_t nested_uniform_scramble(uint32_t v, uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(v), seed));
+}
+
+// The first two Sobol dimensions as 0.32 fixed point numbers.
+static uint32_t sobol_dimension_0(uint32_t index) {
+    return reverse_bits(index);
+}
+
+static uint32_t sobol_dimension_1(uint32_t index) {
+    uint32_t result = 0;
+
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1) {
+            result ^= v;
+        }
+    }
+
+    return result;
+}
+
+void SobolSampler::start_pixel_sample(int x, int y, int sample_index) {
+    this->pixel_hash = hash_pixel_sample(x, y, 0, seed);
+    this->sample_index = sample_index;
+    this->dimension = 0;
+}
+
+float SobolSampler::next_1d() {
+    uint32_t h = hash_dimension(pixel_hash, dimension++);
+    uint32_t index = nested_uniform_scramble(sample_index, h);
+    return to_unit_float(nested_uniform_scramble(sobol_dimension_0(index), h * 0x9e3779b9 + 1));
+}
+
+Vec2 SobolSampler::next_2d() {
+    uint32_t h = hash_dimension(pixel_hash, dimension);
+    dimension += 2;
+
+    uint32_t index = nested_uniform_scramble(sample_index, h);
+    uint32_t x = nested_uniform_scramble(sobol_dimension_0(index), h * 0x9e3779b9 + 1);
+    uint32_t y = nested_uniform_scramble(sobol_dimension_1(index), h * 0x85ebca6b + 2);
+    return Vec2(to_unit_float(x), to_unit_float(y));
+}
+
+Sampler *SobolSampler::clone() {
+    return new SobolSampler(seed);
+}
+
+int SobolSampler::current_dimension() const {
+    return dimension;
+}
+
+void SobolSampler::skip_to_dimension(int dimension) {
+    this->dimension = dimension;
+}
+
+#define BLUE_NOISE_SIZE 64
+
+// Void and cluster, see "The void-and-cluster method for dither array
+// generation" (Ulichney 1993). The final phase keeps filling the largest
+// void instead of switching to the inverted pattern, which is a close
+// enough approximation for decorrelating pixels.
+static std::vector<float> generate_blue_noise_mask() {
+    const int n = BLUE_NOISE_SIZE;
+    const int size = n * n;
+    const float sigma = 1.5;
+
+    std::vector<float> kernel(size);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            int dx = x < n - x ? x : n - x;
+            int dy = y < n - y ? y : n - y;
+            kernel[y * n + x] = expf(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        }
+    }
+
+    std::vector<float> energy(size, 0.0);
+    std::vector<bool> pattern(size, false);
+
+    auto splat = [&](std::vector<float> &e, int p, float sign) {
+        int px = p % n, py = p / n;
+        for (int y = 0; y < n; y++) {
+            const float *row = &kernel[((y - py + n) % n) * n];
+            for (int x = 0; x < n; x++) {
+                e[y * n + x] += sign * row[(x - px + n) % n];
+            }
+        }
+    };
+
+    auto tightest_cluster = [&](const std::vector<float> &e, const std::vector<bool> &b) {
+        int best = -1;
+        for (int i = 0; i < size; i++) {
+            if (b[i] && (best < 0 || e[i] > e[best])) {
+                best = i;
+            }
+        }
+        return best;
+    };
+
+    auto largest_void = [&](const std::vector<float> &e, const std::vector<bool> &b) {
+        int best = -1;
+        for (int i = 0; i < size; i++) {
+            if (!b[i] && (best < 0 || e[i] < e[best])) {
+                best = i;
+            }
+        }
+        return best;
+    };
+
+    PCG32 rng;
+    rng.seed(0x5eed, 0);
+
+    int initial_ones = size / 10;
+    for (int placed = 0; placed < initial_ones; ) {
+        int p = rng.next_uint() % size;
+        if (!pattern[p]) {
+            pattern[p] = true;
+            splat(energy, p, 1.0);
+            placed++;
+        }
+    }
+
+    for (int iteration = 0; iteration < size; iteration++) {
+        int cluster = tightest_cluster(energy, pattern);
+        pattern[cluster] = false;
+        splat(energy, cluster, -1.0);
+
+        int gap = largest_void(energy, pattern);
+        pattern[gap] = true;
+        splat(energy, gap, 1.0);
+
+        if (gap == cluster) {
+            break;
+        }
+    }
+
+    std::vector<int> rank(size, 0);
+
+    {
+        std::vector<float> phase_energy = energy;
+        std::vector<bool> phase_pattern = pattern;
+
+        for (int ones = initial_ones - 1; ones >= 0; ones--) {
+            int cluster = tightest_cluster(phase_energy, phase_pattern);
+            phase_pattern[cluster] = false;
+            splat(phase_energy, cluster, -1.0);
+            rank[cluster] = ones;
+        }
+    }
+
+    for (int ones = initial_ones; ones < size; ones++) {
+        int gap = largest_void(energy, pattern);
+        pattern[gap] = true;
+        splat(energy, gap, 1.0);
+        rank[gap] = ones;
+    }
+
+    std::vector<float> mask(size);
+    for (int i = 0; i < size; i++) {
+        mask[i] = (rank[i] + 0.5f) / size;
+    }
+
+    return mask;
+}
+
+static const std::vector<float> &blue_noise_mask() {
+    static const std::vector<float> mask = generate_blue_noise_mask();
+    return mask;
+}
+
+float BlueNoiseSampler::mask_value(int d) const {
+    uint32_t h = hash_dimension(seed, d);
+    int mx = (x + (h & 0xffff)) % BLUE_NOISE_SIZE;
+    int my = (y + (h >> 16)) % BLUE_NOISE_SIZE;
+    return blue_noise_mask()[my * BLUE_NOISE_SIZE + mx];
+}
+
+void BlueNoiseSampler::start_pixel_sample(int x, int y, int sample_index) {
+    this->x = x;
+    this->y = y;
+    this->sample_index = sample_index;
+    this->dimension = 0;
+}
+
+float BlueNoiseSampler::next_1d() {
+    uint32_t h = hash_dimension(seed, dimension);
+    uint32_t index = nested_uniform_scramble(sample_index, h);
+    float v = to_unit_float(nested_uniform_scramble(sobol_dimension_0(index), h * 0x9e3779b9 + 1)) + mask_value(dimension);
+    dimension++;
+    return v < 1.0f ? v : v - 1.0f;
+}
+
+Vec2 BlueNoiseSampler::next_2d() {
+    uint32_t h = hash_dimension(seed, dimension);
+    uint32_t index = nested_uniform_scramble(sample_index, h);
+
+    float vx = to_unit_float(nested_uniform_scramble(sobol_dimension_0(index), h * 0x9e3779b9 + 1)) + mask_value(dimension);
+    float vy = to_unit_float(nested_uniform_scramble(sobol_dimension_1(index), h * 0x85ebca6b + 2)) + mask_value(dimension + 1);
+    dimension += 2;
+
+    return Vec2(vx < 1.0f ? vx : vx - 1.0f, vy < 1.0f ? vy : vy - 1.0f);
+}
+
+Sampler *BlueNoiseSampler::clone() {
+    return new BlueNoiseSampler(seed);
+}
+
+int BlueNoiseSampler::current_dimension() const {
+    return dimension;
+}
+
+void BlueNoiseSampler::skip_to_dimension(int dimension) {
+    this->dimension = dimension;
+}
+
+Sampler *create_sampler(const char *name, int samples_per_pixel, uint64_t seed) {
+    if (strcmp(name, "random") == 0) {
+        return new RandomSampler(seed);
+    }
+    else if (strcmp(name, "stratified") == 0) {
+        return new StratifiedSampler(samples_per_pixel, seed);
+    }
+    else if (strcmp(name, "sobol") == 0) {
+        return new SobolSampler(seed);
+    }
+    else if (strcmp(name, "bluenoise") == 0) {
+        return new BlueNoiseSampler(seed);
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "vec3.h"
+
+// http://www.pcg-random.org/
+class PCG32 {
+    public:
+        uint64_t state, inc;
+
+        PCG32() {
+            seed(0, 0);
+        };
+
+        void seed(uint64_t initial_state, uint64_t sequence);
+        // Skips delta numbers in O(log delta) steps.
+        void advance(uint64_t delta);
+        uint32_t next_uint();
+        float next_float();
+};
+
+class Sampler {
+    public:
+        virtual ~Sampler() { };
+
+        // Samplers are deterministic functions of the pixel, the sample
+        // index and the seed, so a render is reproducible regardless of
+        // which thread handles a pixel.
+        virtual void start_pixel_sample(int x, int y, int sample_index) = 0;
+        virtual float next_1d() = 0;
+        virtual Vec2 next_2d() = 0;
+        virtual Sampler *clone() = 0;
+
+        // How many dimensions the pixel sample has used, and a jump to a
+        // later dimension right after start_pixel_sample(). Together they
+        // let many paths share one sampler, each restarting its pixel
+        // sample and skipping to where it left off.
+        virtual int current_dimension() const = 0;
+        virtual void skip_to_dimension(int dimension) = 0;
+};
+
+class RandomSampler : public Sampler {
+    private:
+        PCG32 rng;
+        int dimension;
+
+    public:
+        uint64_t seed;
+
+        RandomSampler(uint64_t seed) {
+            this->seed = seed;
+        };
+
+        void start_pixel_sample(int x, int y, int sample_index);
+        float next_1d();
+        Vec2 next_2d();
+        Sampler *clone();
+        int current_dimension() const;
+        void skip_to_dimension(int dimension);
+};
+
+// Jitters within a random permutation of strata in every dimension. 2D
+// samples use an n x n grid when samples_per_pixel is a square and latin
+// hypercube strata otherwise.
+class StratifiedSampler : public Sampler {
+    private:
+        PCG32 rng;
+        uint64_t pixel_hash;
+        int sample_index, dimension;
+
+    public:
+        int samples_per_pixel;
+        uint64_t seed;
+
+        StratifiedSampler(int samples_per_pixel, uint64_t seed) {
+            this->samples_per_pixel = samples_per_pixel;
+            this->seed = seed;
+        };
+
+        void start_pixel_sample(int x, int y, int sample_index);
+        float next_1d();
+        Vec2 next_2d();
+        Sampler *clone();
+        int current_dimension() const;
+        void skip_to_dimension(int dimension);
+};
+
+// Owen-scrambled Sobol points with hash-based scrambling and padding of
+// 2D pairs, see "Practical Hash-based Owen Scrambling" (Burley 2020).
+class SobolSampler : public Sampler {
+    private:
+        uint64_t pixel_hash;
+        int sample_index, dimension;
+
+    public:
+        uint64_t seed;
+
+        SobolSampler(uint64_t seed) {
+            this->seed = seed;
+        };
+
+        void start_pixel_sample(int x, int y, int sample_index);
+        float next_1d();
+        Vec2 next_2d();
+        Sampler *clone();
+        int current_dimension() const;
+        void skip_to_dimension(int dimension);
+};
+
+// Every pixel walks the same scrambled Sobol sequence, toroidally shifted
+// by a blue noise mask so that the error is distributed as blue noise
+// across neighbouring pixels, see "Blue-noise Dithered Sampling"
+// (Georgiev and Fajardo 2016).
+class BlueNoiseSampler : public Sampler {
+    private:
+        int x, y, sample_index, dimension;
+
+        float mask_value(int d) const;
+
+    public:
+        uint64_t seed;
+
+        BlueNoiseSampler(uint64_t seed) {
+            this->seed = seed;
+        };
+
+        void start_pixel_sample(int x, int y, int sample_index);
+        float next_1d();
+        Vec2 next_2d();
+        Sampler *clone();
+        int current_dimension() const;
+        void skip_to_dimension(int dimension);
+};
+
+uint64_t hash_pixel_sample(int x, int y, int sample_index, uint64_t seed);
+
+// Returns nullptr for an unknown sampler name.
+Sampler *create_sampler(const char *name, int samples_per_pixel, uint64_t seed);
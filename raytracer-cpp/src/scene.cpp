@@ -0,0 +1,526 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <unordered_map>
+
+#include "bvh_tree.h"
+#include "mesh_loader.h"
+#include "scene.h"
+#include "text_reader.h"
+
+class SceneParser {
+    private:
+        const char *name;
+        std::string base_directory;
+        Scene &scene;
+        LineReader reader;
+        std::unordered_map<std::string, Texture*> textures;
+        std::unordered_map<std::string, Material*> materials;
+        std::unordered_map<std::string, Hitable*> objects;
+        std::vector<Vec3> transforms;
+
+        // The object being defined between object and end, whose
+        // primitives are collected in object_roots rather than added to
+        // the scene's roots.
+        std::string object_name;
+        bool in_object;
+        std::vector<Hitable*> object_roots;
+
+        // The last material looked up, since primitives tend to come in
+        // runs that share one.
+        std::string last_material_name;
+        Material *last_material;
+
+        char *line;
+
+        bool error(const char *format, ...);
+        bool read_floats(float *values, int count);
+        bool read_vec3(Vec3 &v);
+        const char *read_name(const char *what);
+        Texture *read_texture();
+        Material *read_material();
+        bool end_of_statement();
+        void add_primitive(Hitable *hitable);
+        void add_instance(Hitable *hitable);
+
+        bool parse_camera();
+        bool parse_texture();
+        bool parse_material();
+        bool parse_transform();
+        bool parse_object();
+        bool parse_end();
+        bool parse_instance();
+
+    public:
+        SceneParser(FILE *file, const char *name, const char *base_directory, Scene &scene)
+            : scene(scene), reader(file) {
+            this->name = name;
+            this->base_directory = base_directory;
+            this->last_material = nullptr;
+            this->in_object = false;
+        };
+
+        bool parse();
+};
+
+bool SceneParser::error(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: ", name, reader.line_number);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    return false;
+}
+
+bool SceneParser::read_floats(float *values, int count) {
+    for (int i = 0; i < count; i++) {
+        char *token = next_token(line);
+
+        if (!token) {
+            return error("expected %d more numbers", count - i);
+        }
+        if (!parse_float(token, values[i])) {
+            return error("expected a number instead of '%s'", token);
+        }
+    }
+
+    return true;
+}
+
+bool SceneParser::read_vec3(Vec3 &v) {
+    float values[3];
+
+    if (!read_floats(values, 3)) {
+        return false;
+    }
+
+    v = Vec3(values[0], values[1], values[2]);
+    return true;
+}
+
+const char *SceneParser::read_name(const char *what) {
+    char *token = next_token(line);
+
+    if (!token) {
+        error("expected a %s name", what);
+    }
+
+    return token;
+}
+
+Texture *SceneParser::read_texture() {
+    const char *texture_name = read_name("texture");
+    if (!texture_name) {
+        return nullptr;
+    }
+
+    auto it = textures.find(texture_name);
+    if (it == textures.end()) {
+        error("unknown texture '%s'", texture_name);
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+Material *SceneParser::read_material() {
+    const char *material_name = read_name("material");
+    if (!material_name) {
+        return nullptr;
+    }
+
+    if (last_material && last_material_name == material_name) {
+        return last_material;
+    }
+
+    auto it = materials.find(material_name);
+    if (it == materials.end()) {
+        error("unknown material '%s'", material_name);
+        return nullptr;
+    }
+
+    last_material_name = material_name;
+    last_material = it->second;
+    return last_material;
+}
+
+bool SceneParser::end_of_statement() {
+    char *token = next_token(line);
+
+    if (token) {
+        return error("unexpected '%s'", token);
+    }
+
+    return true;
+}
+
+void SceneParser::add_primitive(Hitable *hitable) {
+    scene.hitables.push_back(hitable);
+    add_instance(hitable);
+}
+
+// Places a hitable the scene already owns, under the pending transforms.
+void SceneParser::add_instance(Hitable *hitable) {
+    for (int i = (int) transforms.size() - 3; i >= 0; i -= 3) {
+        hitable = scene.arena.create<TransformedHitable>(hitable, transforms[i], transforms[i + 1], transforms[i + 2]);
+        scene.hitables.push_back(hitable);
+    }
+
+    transforms.clear();
+
+    if (in_object) {
+        object_roots.push_back(hitable);
+    }
+    else {
+        scene.roots.push_back(hitable);
+    }
+}
+
+bool SceneParser::parse_camera() {
+    Vec3 origin, lower_left, width, height;
+
+    if (!read_vec3(origin) || !read_vec3(lower_left) || !read_vec3(width) || !read_vec3(height)) {
+        return false;
+    }
+
+    scene.camera = Camera(origin, lower_left, width, height);
+    return end_of_statement();
+}
+
+bool SceneParser::parse_texture() {
+    const char *texture_name = read_name("texture");
+    if (!texture_name) {
+        return false;
+    }
+    if (textures.count(texture_name)) {
+        return error("texture '%s' is already defined", texture_name);
+    }
+
+    std::string key = texture_name;
+    const char *type = next_token(line);
+    Texture *texture = nullptr;
+
+    if (!type) {
+        return error("expected a texture type after '%s'", texture_name);
+    }
+    else if (strcmp(type, "constant") == 0) {
+        Vec3 color;
+        if (!read_vec3(color)) {
+            return false;
+        }
+        texture = scene.arena.create<ConstantTexture>(color);
+    }
+    else if (strcmp(type, "checkered") == 0) {
+        Texture *texture0 = read_texture();
+        Texture *texture1 = texture0 ? read_texture() : nullptr;
+        if (!texture1) {
+            return false;
+        }
+        texture = scene.arena.create<CheckeredTexture>(texture0, texture1);
+    }
+    else if (strcmp(type, "image") == 0) {
+        const char *file_name = read_name("image file");
+        if (!file_name) {
+            return false;
+        }
+
+        std::string path = file_name[0] == '/' ? file_name : base_directory + file_name;
+        ImageTexture *image = scene.arena.create<ImageTexture>(path.c_str(), TEXTURE_FILTER_TRILINEAR, &scene.texture_cache);
+        if (!image->readable()) {
+            return error("could not load image '%s'", path.c_str());
+        }
+
+        while (const char *option = next_token(line)) {
+            if (strcmp(option, "linear") == 0) {
+                image->srgb = false;
+            }
+            else if (strcmp(option, "compressed") == 0) {
+                image->compressed = true;
+            }
+            else if (!parse_texture_filter(option, image->filter)) {
+                return error("unknown texture option '%s', expected nearest, bilinear, trilinear, ewa, linear or compressed", option);
+            }
+        }
+
+        if (scene.texture_compression >= 0) {
+            image->compressed = scene.texture_compression == 1;
+        }
+        image->tile_directory = scene.texture_tile_directory;
+        if (!image->tile_directory.empty()) {
+            image->convert();
+        }
+        texture = image;
+    }
+    else {
+        return error("unknown texture type '%s', expected constant, checkered or image", type);
+    }
+
+    scene.textures.push_back(texture);
+    textures[key] = texture;
+    return end_of_statement();
+}
+
+bool SceneParser::parse_material() {
+    const char *material_name = read_name("material");
+    if (!material_name) {
+        return false;
+    }
+    if (materials.count(material_name)) {
+        return error("material '%s' is already defined", material_name);
+    }
+
+    std::string key = material_name;
+    const char *type = next_token(line);
+    if (!type) {
+        return error("expected a material type after '%s'", material_name);
+    }
+
+    Texture *texture = read_texture();
+    if (!texture) {
+        return false;
+    }
+
+    Material *material;
+    if (strcmp(type, "lambertian") == 0) {
+        material = scene.arena.create<Material>(MATERIAL_LAMBERTIAN, texture);
+    }
+    else if (strcmp(type, "metal") == 0) {
+        material = scene.arena.create<Material>(MATERIAL_METAL, texture);
+    }
+    else if (strcmp(type, "light") == 0) {
+        material = scene.arena.create<Material>(MATERIAL_LIGHT, texture);
+    }
+    else {
+        return error("unknown material type '%s', expected lambertian, metal or light", type);
+    }
+
+    scene.materials.push_back(material);
+    materials[key] = material;
+    return end_of_statement();
+}
+
+bool SceneParser::parse_transform() {
+    Vec3 translation, rotation, scale;
+
+    if (!read_vec3(translation) || !read_vec3(rotation) || !read_vec3(scale)) {
+        return false;
+    }
+    if (scale.x == 0.0 || scale.y == 0.0 || scale.z == 0.0) {
+        return error("scale of zero along an axis");
+    }
+
+    const double radians = M_PI / 180.0;
+    transforms.push_back(translation);
+    transforms.push_back(Vec3(rotation.x * radians, rotation.y * radians, rotation.z * radians));
+    transforms.push_back(scale);
+    return end_of_statement();
+}
+
+bool SceneParser::parse_object() {
+    const char *object = read_name("object");
+    if (!object) {
+        return false;
+    }
+    if (in_object) {
+        return error("object '%s' inside object '%s'", object, object_name.c_str());
+    }
+    if (objects.count(object)) {
+        return error("object '%s' is already defined", object);
+    }
+    if (!transforms.empty()) {
+        return error("transform before an object, transform its instances instead");
+    }
+
+    object_name = object;
+    in_object = true;
+    return end_of_statement();
+}
+
+// An object of one primitive is instanced directly, otherwise its
+// primitives get a BVH of their own that all instances share.
+bool SceneParser::parse_end() {
+    if (!in_object) {
+        return error("end without an object");
+    }
+    if (!transforms.empty()) {
+        return error("transform without a primitive after it");
+    }
+    if (object_roots.empty()) {
+        return error("object '%s' is empty", object_name.c_str());
+    }
+
+    Hitable *object = object_roots[0];
+    if (object_roots.size() > 1) {
+        object = scene.arena.create<BVHTree>(object_roots);
+        scene.hitables.push_back(object);
+    }
+
+    objects[object_name] = object;
+    object_roots.clear();
+    in_object = false;
+    return end_of_statement();
+}
+
+bool SceneParser::parse_instance() {
+    const char *object = read_name("object");
+    if (!object) {
+        return false;
+    }
+
+    auto it = objects.find(object);
+    if (it == objects.end()) {
+        return error("unknown object '%s'", object);
+    }
+
+    add_instance(it->second);
+    scene.num_instances++;
+    return end_of_statement();
+}
+
+bool SceneParser::parse() {
+    bool has_camera = false;
+
+    while ((line = reader.next_line())) {
+        char *keyword = next_token(line);
+
+        if (!keyword) {
+            continue;
+        }
+
+        if (strcmp(keyword, "sphere") == 0) {
+            float values[4];
+            Material *material = read_material();
+
+            if (!material || !read_floats(values, 4) || !end_of_statement()) {
+                return false;
+            }
+
+            Sphere *sphere = scene.arena.create<Sphere>(Vec3(values[0], values[1], values[2]), values[3]);
+            sphere->material = material;
+            add_primitive(sphere);
+        }
+        else if (strcmp(keyword, "rect") == 0) {
+            float values[5];
+            Material *material = read_material();
+
+            if (!material || !read_floats(values, 5) || !end_of_statement()) {
+                return false;
+            }
+
+            XYRect *rect = scene.arena.create<XYRect>(Vec3(values[0], values[1], values[4]), Vec3(values[2], values[3], values[4]));
+            rect->material = material;
+            add_primitive(rect);
+        }
+        else if (strcmp(keyword, "box") == 0) {
+            float values[6];
+            Material *material = read_material();
+
+            if (!material || !read_floats(values, 6) || !end_of_statement()) {
+                return false;
+            }
+
+            Box *box = scene.arena.create<Box>(Vec3(values[0], values[1], values[2]), Vec3(values[3], values[4], values[5]));
+            box->material = material;
+            add_primitive(box);
+        }
+        else if (strcmp(keyword, "mesh") == 0) {
+            Material *material = read_material();
+            const char *file_name = material ? read_name("mesh file") : nullptr;
+
+            if (!file_name) {
+                return false;
+            }
+
+            std::string path = file_name[0] == '/' ? file_name : base_directory + file_name;
+            TriangleMesh *mesh = scene.arena.create<TriangleMesh>();
+            if (!load_mesh(path.c_str(), *mesh)) {
+                return error("could not load mesh '%s'", path.c_str());
+            }
+
+            mesh->material = material;
+            add_primitive(mesh);
+            scene.num_triangles += mesh->num_triangles();
+
+            if (!end_of_statement()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "transform") == 0) {
+            if (!parse_transform()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "instance") == 0) {
+            if (!parse_instance()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "object") == 0) {
+            if (!parse_object()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "end") == 0) {
+            if (!parse_end()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "material") == 0) {
+            if (!parse_material()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "texture") == 0) {
+            if (!parse_texture()) {
+                return false;
+            }
+        }
+        else if (strcmp(keyword, "camera") == 0) {
+            if (!parse_camera()) {
+                return false;
+            }
+            has_camera = true;
+        }
+        else {
+            return error("unknown statement '%s'", keyword);
+        }
+    }
+
+    if (reader.failed()) {
+        return error("could not read the file");
+    }
+    if (!transforms.empty()) {
+        return error("transform without a primitive after it");
+    }
+    if (in_object) {
+        return error("object '%s' has no end", object_name.c_str());
+    }
+    if (!has_camera) {
+        return error("no camera");
+    }
+
+    return true;
+}
+
+bool load_scene(FILE *file, const char *name, const char *base_directory, Scene &scene) {
+    SceneParser parser(file, name, base_directory, scene);
+    return parser.parse();
+}
+
+bool load_scene(const char *path, Scene &scene) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open scene '%s'\n", path);
+        return false;
+    }
+
+    const char *slash = strrchr(path, '/');
+    std::string base_directory = slash ? std::string(path, slash - path + 1) : "";
+
+    bool loaded = load_scene(file, path, base_directory.c_str(), scene);
+    fclose(file);
+    return loaded;
+}
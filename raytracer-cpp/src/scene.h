@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "hitables.h"
+#include "material.h"
+#include "scene_arena.h"
+#include "texture.h"
+
+// Everything a scene file describes. Every texture, material and hitable
+// lives in the arena and is freed with the scene, and the lists only refer
+// to them. Roots are the hitables at the top level, the ones to build the
+// BVH over. Image textures read their texels through texture_cache.
+class Scene {
+    public:
+        SceneArena arena;
+        TextureCache texture_cache;
+        std::vector<Texture*> textures;
+        std::vector<Material*> materials;
+        std::vector<Hitable*> hitables;
+        std::vector<Hitable*> roots;
+        Camera camera;
+        long long num_triangles;
+        long long num_instances;
+        // Set before loading to override whether image textures are
+        // compressed, or left at -1 to go by the scene file.
+        int texture_compression;
+        // Set before loading to keep image texture tiles there for later
+        // loads. Image textures are then converted while loading, and
+        // otherwise on their first lookup.
+        std::string texture_tile_directory;
+
+        Scene() {
+            this->num_triangles = 0;
+            this->num_instances = 0;
+            this->texture_compression = -1;
+        };
+};
+
+// Scene files are text with one statement per line and # starting a
+// comment. Textures and materials are named and have to be defined before
+// they are used. Transforms wrap the primitive on the next line, scaling it,
+// rotating it about z first, then y, then x, and translating it last.
+// Consecutive transforms nest with the first one outermost. Primitives
+// between object and end are not placed in the scene but make up an object
+// that instance statements place, under transforms like a primitive, with
+// every instance sharing the object's BVH. Angles are in degrees, and image
+// and mesh paths are relative to the scene file. Image textures are
+// filtered trilinearly unless they name another filter. Their 8-bit values
+// are taken as sRGB unless they are marked linear, as data like masks
+// should be, and compressed ones are stored as BC1 blocks.
+//
+//   camera origin lower_left width height       (four points or vectors)
+//   texture name constant r g b
+//   texture name checkered texture0 texture1
+//   texture name image path [nearest|bilinear|trilinear|ewa] [linear] [compressed]
+//   material name lambertian|metal|light texture
+//   transform tx ty tz rx ry rz sx sy sz
+//   sphere material x y z radius
+//   rect material min_x min_y max_x max_y z
+//   box material min_x min_y min_z max_x max_y max_z
+//   mesh material path                          (.obj or binary .ply)
+//   object name
+//   end
+//   instance name
+//
+// The file is read in blocks rather than whole, so the loader's memory use
+// does not grow with the file. Errors are printed with their line number.
+bool load_scene(const char *path, Scene &scene);
+bool load_scene(FILE *file, const char *name, const char *base_directory, Scene &scene);
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene_arena.h"
+
+SceneArena::~SceneArena() {
+    for (size_t i = destructors.size(); i > 0; i--) {
+        destructors[i - 1].destroy(destructors[i - 1].object);
+    }
+    for (char *block : blocks) {
+        free(block);
+    }
+}
+
+// Objects too big to share a block get one of their own, which leaves the
+// current block as it is.
+void *SceneArena::allocate(size_t size, size_t alignment) {
+    size_t padding = (alignment - (uintptr_t) current % alignment) % alignment;
+
+    if (!current || padding + size > remaining) {
+        size_t new_block_size = size + alignment > block_size ? size + alignment : block_size;
+        char *block = (char*) malloc(new_block_size);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        blocks.push_back(block);
+
+        if (new_block_size > block_size) {
+            bytes_allocated += size;
+            return block + (alignment - (uintptr_t) block % alignment) % alignment;
+        }
+
+        current = block;
+        remaining = block_size;
+        padding = (alignment - (uintptr_t) current % alignment) % alignment;
+    }
+
+    char *result = current + padding;
+    current += padding + size;
+    remaining -= padding + size;
+    bytes_allocated += size;
+    return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Owns everything a scene loads. Objects are bump allocated one after
+// another in large blocks, so a primitive lands next to the transform and
+// material created just before and after it, and nothing is freed until the
+// arena is. The arena then runs the destructors of the objects that have
+// one, newest first, and releases the blocks all at once.
+//
+// Creation order is good enough for traversal, since BVH leaves test copies
+// of their shapes kept in leaf order by PrimitiveArrays and only reach into
+// the arena for the closest hit of a leaf.
+class SceneArena {
+    private:
+        struct Destructor {
+            void (*destroy)(void *object);
+            void *object;
+        };
+
+        std::vector<char*> blocks;
+        std::vector<Destructor> destructors;
+        char *current;
+        size_t remaining;
+        size_t bytes_allocated;
+
+        void *allocate(size_t size, size_t alignment);
+
+        template <class T>
+        static void destroy(void *object) {
+            static_cast<T*>(object)->~T();
+        }
+
+    public:
+        static const size_t block_size = 1 << 20;
+
+        SceneArena() {
+            this->current = nullptr;
+            this->remaining = 0;
+            this->bytes_allocated = 0;
+        };
+        ~SceneArena();
+
+        SceneArena(const SceneArena&) = delete;
+        SceneArena &operator=(const SceneArena&) = delete;
+
+        template <class T, class... Args>
+        T *create(Args&&... args) {
+            T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+            if (!std::is_trivially_destructible<T>::value) {
+                destructors.push_back({ &destroy<T>, object });
+            }
+            return object;
+        };
+
+        // Bytes handed out so far, not counting the unused ends of blocks or
+        // memory the objects allocate themselves, like mesh buffers.
+        size_t size() const {
+            return bytes_allocated;
+        };
+};
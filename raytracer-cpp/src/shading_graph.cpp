@@ -0,0 +1,146 @@
+#include <math.h>
+#include <algorithm>
+
+#include "shading_graph.h"
+#include "simd.h"
+
+// sin(10 x) is negative where floor(10 x / pi) is odd, so the product of
+// the three sines a CheckeredTexture tests is negative where the sum of
+// the three floors is.
+static const float checker_scale = 10.0 / M_PI;
+
+static inline float vfloor(float a) {
+    return floorf(a);
+}
+
+// One where a checker takes its first input and zero where it takes its
+// second, for a float or for SIMD lanes.
+template <class T>
+static T checker_parity(const T &x, const T &y, const T &z) {
+    T scale = T(checker_scale);
+    T sum = vfloor(x * scale) + vfloor(y * scale) + vfloor(z * scale);
+    return sum - T(2.0f) * vfloor(T(0.5f) * sum);
+}
+
+ShadingGraph::ShadingGraph(const std::vector<Material*> &materials) {
+    std::unordered_map<Texture*, int> nodes_of_textures;
+
+    ShadingNode black;
+    black.op = SHADING_CONSTANT;
+    black.inputs[0] = black.inputs[1] = -1;
+    black.color = Vec3(0.0, 0.0, 0.0);
+    black.image = nullptr;
+    nodes.push_back(black);
+
+    for (Material *material : materials) {
+        material->albedo_node = add_texture(material->albedo, nodes_of_textures);
+    }
+}
+
+// Inputs are added before the checkers that use them. Scene files define
+// textures before using them, so there are no cycles to guard against.
+int ShadingGraph::add_texture(Texture *texture, std::unordered_map<Texture*, int> &nodes_of_textures) {
+    auto it = nodes_of_textures.find(texture);
+    if (it != nodes_of_textures.end()) {
+        return it->second;
+    }
+
+    ShadingNode node;
+    node.op = SHADING_CONSTANT;
+    node.inputs[0] = node.inputs[1] = -1;
+    node.color = Vec3(0.0, 0.0, 0.0);
+    node.image = nullptr;
+
+    switch (texture->type) {
+        case TEXTURE_CONSTANT:
+            node.color = static_cast<ConstantTexture*>(texture)->color;
+            break;
+        case TEXTURE_CHECKERED: {
+            CheckeredTexture *checkered = static_cast<CheckeredTexture*>(texture);
+            node.op = SHADING_CHECKER;
+            node.inputs[0] = add_texture(checkered->texture0, nodes_of_textures);
+            node.inputs[1] = add_texture(checkered->texture1, nodes_of_textures);
+
+            if (node.inputs[0] == node.inputs[1]) {
+                nodes_of_textures[texture] = node.inputs[0];
+                return node.inputs[0];
+            }
+            break;
+        }
+        case TEXTURE_IMAGE:
+            node.op = SHADING_IMAGE;
+            node.image = static_cast<ImageTexture*>(texture);
+            break;
+    }
+
+    nodes.push_back(node);
+    nodes_of_textures[texture] = nodes.size() - 1;
+    return nodes.size() - 1;
+}
+
+// Follows checkers down to a constant or an image, taking the first input
+// of each where first is set.
+static int find_leaf(const ShadingNode *nodes, int index, bool first) {
+    while (nodes[index].op == SHADING_CHECKER) {
+        index = nodes[index].inputs[first ? 0 : 1];
+    }
+
+    return index;
+}
+
+Vec3 ShadingGraph::evaluate(int node, const TextureCoord &t, const Vec3 &p) const {
+    const ShadingNode &leaf = nodes[find_leaf(nodes.data(), node, checker_parity(p.x, p.y, p.z) != 0.0f)];
+    return leaf.op == SHADING_IMAGE ? leaf.image->value(t, p) : leaf.color;
+}
+
+// Works through the points in chunks. The leaves of a chunk are found first,
+// eight points at a time, and constants are written straight away. The
+// points on images are then sorted by image, so that each image's tiles are
+// looked up while they are at hand rather than between other images'.
+void ShadingGraph::evaluate(int count, const int *roots, const TextureCoord *t, const Vec3 *p, Vec3 *colors) const {
+    const int lanes = Float8::width;
+    const int chunk_size = 256;
+    int leaves[chunk_size], on_images[chunk_size];
+
+    for (int start = 0; start < count; start += chunk_size) {
+        int n = std::min(chunk_size, count - start);
+        int num_on_images = 0;
+
+        for (int i = 0; i < n; i += lanes) {
+            int m = std::min(lanes, n - i);
+            float xs[lanes] = { }, ys[lanes] = { }, zs[lanes] = { }, parity[lanes];
+
+            for (int l = 0; l < m; l++) {
+                xs[l] = p[start + i + l].x;
+                ys[l] = p[start + i + l].y;
+                zs[l] = p[start + i + l].z;
+            }
+
+            checker_parity(Float8::load(xs), Float8::load(ys), Float8::load(zs)).store(parity);
+
+            for (int l = 0; l < m; l++) {
+                leaves[i + l] = find_leaf(nodes.data(), roots[start + i + l], parity[l] != 0.0f);
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            const ShadingNode &leaf = nodes[leaves[i]];
+
+            if (leaf.op == SHADING_IMAGE) {
+                on_images[num_on_images++] = i;
+            }
+            else {
+                colors[start + i] = leaf.color;
+            }
+        }
+
+        std::sort(on_images, on_images + num_on_images, [&](int a, int b) {
+            return leaves[a] != leaves[b] ? leaves[a] < leaves[b] : a < b;
+        });
+
+        for (int k = 0; k < num_on_images; k++) {
+            int i = on_images[k];
+            colors[start + i] = nodes[leaves[i]].image->value(t[start + i], p[start + i]);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "material.h"
+#include "texture.h"
+#include "vec3.h"
+
+enum ShadingOp {
+    SHADING_CONSTANT,
+    SHADING_CHECKER,
+    SHADING_IMAGE
+};
+
+// One texture of a ShadingGraph. Checkers pick between inputs, the indices
+// of earlier nodes.
+struct ShadingNode {
+    ShadingOp op;
+    int inputs[2];
+    Vec3 color;
+    ImageTexture *image;
+};
+
+// The textures of a scene's materials flattened into an array of nodes, so
+// that a lookup walks down the array by index instead of recursing through
+// virtual calls. Every checker splits space the same way, so which of its
+// inputs a checker takes is worked out once per point, from the parity of
+// the cube the point lies in rather than from three sines, and then a
+// lookup follows checkers to a constant or image node. Points are looked up
+// one at a time or in batches. Batches find their cubes in SIMD and look up
+// the points on each image together, though every point's texels are still
+// filtered on their own. Node 0 is always black.
+class ShadingGraph {
+    private:
+        int add_texture(Texture *texture, std::unordered_map<Texture*, int> &nodes_of_textures);
+
+    public:
+        std::vector<ShadingNode> nodes;
+
+        // Sets the albedo_node of every material. Textures materials share
+        // become one node, as do checkers of a texture with itself.
+        ShadingGraph(const std::vector<Material*> &materials);
+
+        Vec3 evaluate(int node, const TextureCoord &t, const Vec3 &p) const;
+
+        // colors[i] = evaluate(roots[i], t[i], p[i]) for i below count.
+        void evaluate(int count, const int *roots, const TextureCoord *t, const Vec3 *p, Vec3 *colors) const;
+};
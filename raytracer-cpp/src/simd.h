@@ -0,0 +1,170 @@
+#pragma once
+
+#include <immintrin.h>
+
+// Thin wrappers over SSE and AVX registers so that packet code can be
+// written once and instantiated for 4 and 8 wide packets. Comparisons
+// return all-ones or all-zero lanes which can be combined with & and |
+// and consumed by select() and mask().
+class Float4 {
+    public:
+        static const int width = 4;
+
+        __m128 v;
+
+        Float4() { };
+
+        Float4(__m128 v) {
+            this->v = v;
+        };
+
+        Float4(float f) {
+            this->v = _mm_set1_ps(f);
+        };
+
+        static Float4 load(const float *p) {
+            return Float4(_mm_loadu_ps(p));
+        };
+
+        void store(float *p) const {
+            _mm_storeu_ps(p, v);
+        };
+
+        int mask() const {
+            return _mm_movemask_ps(v);
+        };
+
+        static Float4 select(const Float4 &m, const Float4 &a, const Float4 &b) {
+            return Float4(_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)));
+        };
+};
+
+inline Float4 operator+(const Float4 &a, const Float4 &b) { return Float4(_mm_add_ps(a.v, b.v)); }
+inline Float4 operator-(const Float4 &a, const Float4 &b) { return Float4(_mm_sub_ps(a.v, b.v)); }
+inline Float4 operator*(const Float4 &a, const Float4 &b) { return Float4(_mm_mul_ps(a.v, b.v)); }
+inline Float4 operator/(const Float4 &a, const Float4 &b) { return Float4(_mm_div_ps(a.v, b.v)); }
+inline Float4 operator&(const Float4 &a, const Float4 &b) { return Float4(_mm_and_ps(a.v, b.v)); }
+inline Float4 operator|(const Float4 &a, const Float4 &b) { return Float4(_mm_or_ps(a.v, b.v)); }
+inline Float4 operator<(const Float4 &a, const Float4 &b) { return Float4(_mm_cmplt_ps(a.v, b.v)); }
+inline Float4 operator<=(const Float4 &a, const Float4 &b) { return Float4(_mm_cmple_ps(a.v, b.v)); }
+inline Float4 operator>(const Float4 &a, const Float4 &b) { return Float4(_mm_cmpgt_ps(a.v, b.v)); }
+inline Float4 operator>=(const Float4 &a, const Float4 &b) { return Float4(_mm_cmpge_ps(a.v, b.v)); }
+inline Float4 vmin(const Float4 &a, const Float4 &b) { return Float4(_mm_min_ps(a.v, b.v)); }
+inline Float4 vmax(const Float4 &a, const Float4 &b) { return Float4(_mm_max_ps(a.v, b.v)); }
+inline Float4 vsqrt(const Float4 &a) { return Float4(_mm_sqrt_ps(a.v)); }
+
+#ifdef __SSE4_1__
+inline Float4 vfloor(const Float4 &a) { return Float4(_mm_floor_ps(a.v)); }
+#else
+// Truncates and steps down where that rounded up, for values that fit an int.
+inline Float4 vfloor(const Float4 &a) {
+    Float4 t = Float4(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)));
+    return t - ((t > a) & Float4(1.0f));
+}
+#endif
+
+#ifdef __AVX__
+
+class Float8 {
+    public:
+        static const int width = 8;
+
+        __m256 v;
+
+        Float8() { };
+
+        Float8(__m256 v) {
+            this->v = v;
+        };
+
+        Float8(float f) {
+            this->v = _mm256_set1_ps(f);
+        };
+
+        static Float8 load(const float *p) {
+            return Float8(_mm256_loadu_ps(p));
+        };
+
+        void store(float *p) const {
+            _mm256_storeu_ps(p, v);
+        };
+
+        int mask() const {
+            return _mm256_movemask_ps(v);
+        };
+
+        static Float8 select(const Float8 &m, const Float8 &a, const Float8 &b) {
+            return Float8(_mm256_blendv_ps(b.v, a.v, m.v));
+        };
+};
+
+inline Float8 operator+(const Float8 &a, const Float8 &b) { return Float8(_mm256_add_ps(a.v, b.v)); }
+inline Float8 operator-(const Float8 &a, const Float8 &b) { return Float8(_mm256_sub_ps(a.v, b.v)); }
+inline Float8 operator*(const Float8 &a, const Float8 &b) { return Float8(_mm256_mul_ps(a.v, b.v)); }
+inline Float8 operator/(const Float8 &a, const Float8 &b) { return Float8(_mm256_div_ps(a.v, b.v)); }
+inline Float8 operator&(const Float8 &a, const Float8 &b) { return Float8(_mm256_and_ps(a.v, b.v)); }
+inline Float8 operator|(const Float8 &a, const Float8 &b) { return Float8(_mm256_or_ps(a.v, b.v)); }
+inline Float8 operator<(const Float8 &a, const Float8 &b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+inline Float8 operator<=(const Float8 &a, const Float8 &b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+inline Float8 operator>(const Float8 &a, const Float8 &b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+inline Float8 operator>=(const Float8 &a, const Float8 &b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+inline Float8 vmin(const Float8 &a, const Float8 &b) { return Float8(_mm256_min_ps(a.v, b.v)); }
+inline Float8 vmax(const Float8 &a, const Float8 &b) { return Float8(_mm256_max_ps(a.v, b.v)); }
+inline Float8 vsqrt(const Float8 &a) { return Float8(_mm256_sqrt_ps(a.v)); }
+inline Float8 vfloor(const Float8 &a) { return Float8(_mm256_floor_ps(a.v)); }
+
+#else
+
+// Without AVX an 8 wide packet is processed as two SSE halves.
+class Float8 {
+    public:
+        static const int width = 8;
+
+        Float4 lo, hi;
+
+        Float8() { };
+
+        Float8(const Float4 &lo, const Float4 &hi) {
+            this->lo = lo;
+            this->hi = hi;
+        };
+
+        Float8(float f) {
+            this->lo = Float4(f);
+            this->hi = Float4(f);
+        };
+
+        static Float8 load(const float *p) {
+            return Float8(Float4::load(p), Float4::load(p + 4));
+        };
+
+        void store(float *p) const {
+            lo.store(p);
+            hi.store(p + 4);
+        };
+
+        int mask() const {
+            return lo.mask() | (hi.mask() << 4);
+        };
+
+        static Float8 select(const Float8 &m, const Float8 &a, const Float8 &b) {
+            return Float8(Float4::select(m.lo, a.lo, b.lo), Float4::select(m.hi, a.hi, b.hi));
+        };
+};
+
+inline Float8 operator+(const Float8 &a, const Float8 &b) { return Float8(a.lo + b.lo, a.hi + b.hi); }
+inline Float8 operator-(const Float8 &a, const Float8 &b) { return Float8(a.lo - b.lo, a.hi - b.hi); }
+inline Float8 operator*(const Float8 &a, const Float8 &b) { return Float8(a.lo * b.lo, a.hi * b.hi); }
+inline Float8 operator/(const Float8 &a, const Float8 &b) { return Float8(a.lo / b.lo, a.hi / b.hi); }
+inline Float8 operator&(const Float8 &a, const Float8 &b) { return Float8(a.lo & b.lo, a.hi & b.hi); }
+inline Float8 operator|(const Float8 &a, const Float8 &b) { return Float8(a.lo | b.lo, a.hi | b.hi); }
+inline Float8 operator<(const Float8 &a, const Float8 &b) { return Float8(a.lo < b.lo, a.hi < b.hi); }
+inline Float8 operator<=(const Float8 &a, const Float8 &b) { return Float8(a.lo <= b.lo, a.hi <= b.hi); }
+inline Float8 operator>(const Float8 &a, const Float8 &b) { return Float8(a.lo > b.lo, a.hi > b.hi); }
+inline Float8 operator>=(const Float8 &a, const Float8 &b) { return Float8(a.lo >= b.lo, a.hi >= b.hi); }
+inline Float8 vmin(const Float8 &a, const Float8 &b) { return Float8(vmin(a.lo, b.lo), vmin(a.hi, b.hi)); }
+inline Float8 vmax(const Float8 &a, const Float8 &b) { return Float8(vmax(a.lo, b.lo), vmax(a.hi, b.hi)); }
+inline Float8 vsqrt(const Float8 &a) { return Float8(vsqrt(a.lo), vsqrt(a.hi)); }
+inline Float8 vfloor(const Float8 &a) { return Float8(vfloor(a.lo), vfloor(a.hi)); }
+
+#endif
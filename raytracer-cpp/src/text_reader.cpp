@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_reader.h"
+
+char *LineReader::next_line() {
+    for (;;) {
+        char *newline = (char*) memchr(&buffer[begin], '\n', end - begin);
+
+        if (newline || (at_end && begin < end)) {
+            char *line = &buffer[begin];
+
+            if (newline) {
+                *newline = '\0';
+                begin = newline - &buffer[0] + 1;
+            }
+            else {
+                // There is always room for this, see below.
+                buffer[end] = '\0';
+                begin = end;
+            }
+
+            line_number++;
+            return line;
+        }
+
+        if (at_end) {
+            return nullptr;
+        }
+
+        memmove(&buffer[0], &buffer[begin], end - begin);
+        end -= begin;
+        begin = 0;
+
+        // Keeps a byte free to terminate a last line with no newline.
+        if (end + 1 >= buffer.size()) {
+            buffer.resize(2 * buffer.size());
+        }
+
+        size_t count = fread(&buffer[end], 1, buffer.size() - end - 1, file);
+        end += count;
+        at_end = count == 0;
+    }
+}
+
+char *next_token(char *&p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+
+    if (*p == '\0' || *p == '#') {
+        return nullptr;
+    }
+
+    char *token = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') {
+        p++;
+    }
+
+    if (*p == '#') {
+        // Terminating the token would hide the comment from the next call.
+        *p = '\0';
+    }
+    else if (*p != '\0') {
+        *p++ = '\0';
+    }
+
+    return token;
+}
+
+bool parse_float(const char *token, float &value) {
+    const char *p = token;
+    bool negative = *p == '-';
+
+    if (*p == '-' || *p == '+') {
+        p++;
+    }
+
+    long long mantissa = 0;
+    int digits = 0, fraction_digits = 0;
+    bool fraction = false;
+
+    for (; *p != '\0'; p++) {
+        if (*p >= '0' && *p <= '9') {
+            mantissa = 10 * mantissa + (*p - '0');
+            digits++;
+            fraction_digits += fraction;
+        }
+        else if (*p == '.' && !fraction) {
+            fraction = true;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (*p == '\0' && digits > 0 && digits <= 15) {
+        static const double powers_of_ten[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+        };
+        double v = (double) mantissa / powers_of_ten[fraction_digits];
+        value = negative ? -v : v;
+        return true;
+    }
+
+    char *token_end;
+    value = strtof(token, &token_end);
+    return token_end != token && *token_end == '\0';
+}
+
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+// Hands out the file a line at a time from a block buffer. A line longer
+// than the buffer grows it.
+class LineReader {
+    private:
+        FILE *file;
+        std::vector<char> buffer;
+        size_t begin, end;
+        bool at_end;
+
+    public:
+        int line_number;
+
+        LineReader(FILE *file) {
+            this->file = file;
+            this->buffer.resize(1 << 20);
+            this->begin = 0;
+            this->end = 0;
+            this->at_end = false;
+            this->line_number = 0;
+        };
+
+        // Returns the next line without its newline, or nullptr at the end.
+        char *next_line();
+
+        bool failed() {
+            return ferror(file) != 0;
+        };
+};
+
+// Splits off the next whitespace separated token of a line, stopping at a
+// # comment, and returns nullptr when there are none left.
+char *next_token(char *&p);
+
+// Plain decimals with up to 15 significant digits, which is most of the
+// numbers in a large scene or mesh, are read exactly into a double. That is
+// about 2.5 times faster than strtof, which handles anything else.
+bool parse_float(const char *token, float &value);
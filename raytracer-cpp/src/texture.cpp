@@ -1,27 +1,619 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "image_reader.h"
+#include "image_writer.h"
 #include "texture.h"
 
-Vec3 ConstantTexture::value(const Vec2 &t, const Vec3 &p) {
-    return color;   
+bool parse_texture_filter(const char *name, TextureFilter &filter) {
+    if (strcmp(name, "nearest") == 0) {
+        filter = TEXTURE_FILTER_NEAREST;
+    }
+    else if (strcmp(name, "bilinear") == 0) {
+        filter = TEXTURE_FILTER_BILINEAR;
+    }
+    else if (strcmp(name, "trilinear") == 0) {
+        filter = TEXTURE_FILTER_TRILINEAR;
+    }
+    else if (strcmp(name, "ewa") == 0) {
+        filter = TEXTURE_FILTER_EWA;
+    }
+    else {
+        return false;
+    }
+
+    return true;
 }
 
-Vec3 CheckeredTexture::value(const Vec2 &t, const Vec3 &p) {
-    float sines = sin(10 * p.x) * sin(10 * p.y) * sin(10 * p.z); 
+// How far apart the texels at the ends of the minor axis of an EWA
+// footprint may be, at most, relative to its major axis. Longer footprints
+// are widened, blurring them a little rather than reading more texels.
+static const float max_anisotropy = 8.0;
+
+// exp(-2 r^2) - exp(-2) for r^2 from 0 to 1, the Gaussian EWA weights
+// texels with, cut off to reach zero at the edge of the ellipse.
+class EwaWeights {
+    public:
+        static const int size = 128;
+        float table[size];
+
+        EwaWeights() {
+            for (int i = 0; i < size; i++) {
+                float r2 = (float) i / (size - 1);
+                table[i] = expf(-2.0 * r2) - expf(-2.0);
+            }
+        };
+};
+
+static const EwaWeights ewa_weights;
 
-    if (sines < 0) {
-        return texture0->value(t, p);
+ImageTexture::ImageTexture(const char *image_file_name, TextureFilter filter, TextureCache *cache) : Texture(TEXTURE_IMAGE) {
+    this->path = image_file_name;
+    this->filter = filter;
+    this->cache = cache;
+    this->tile_file = nullptr;
+    this->tile_bytes = 0;
+    this->decode_table = nullptr;
+    this->srgb = true;
+    this->compressed = false;
+    this->format = TEXTURE_FORMAT_RGB8;
+    this->id = TextureCache::add_texture();
+
+    // PFM and EXR files go through read_image(), which has no way to read
+    // just the header.
+    ImageFormat image_format;
+    int width, height, n;
+
+    if (image_format_from_path(image_file_name, image_format) && is_hdr_format(image_format)) {
+        FILE *file = fopen(image_file_name, "rb");
+        readable_file = file != nullptr;
+        if (file) {
+            fclose(file);
+        }
     }
     else {
-        return texture1->value(t, p);
+        readable_file = stbi_info(image_file_name, &width, &height, &n) != 0;
+    }
+}
+
+ImageTexture::~ImageTexture() {
+    if (tile_file) {
+        fclose(tile_file);
+    }
+}
+
+void ImageTexture::add_levels(int width, int height) {
+    long long first_tile = 0;
+
+    while (true) {
+        MipLevel level;
+        level.width = width;
+        level.height = height;
+        level.tiles_x = (width + TextureTile::size - 1) / TextureTile::size;
+        level.tiles_y = (height + TextureTile::size - 1) / TextureTile::size;
+        level.first_tile = first_tile;
+        levels.push_back(level);
+        first_tile += (long long) level.tiles_x * level.tiles_y;
+
+        if (width == 1 && height == 1) {
+            break;
+        }
+
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+// Each level averages 2x2 blocks of the one above. An odd row or column is
+// averaged with itself, so sizes round up instead of losing the edge.
+template <class T, class Decode, class Encode>
+static std::vector<T> downsample(const std::vector<T> &above, int width, int height, int channels, Decode decode, Encode encode) {
+    int half_width = (width + 1) / 2, half_height = (height + 1) / 2;
+    std::vector<T> result((size_t) channels * half_width * half_height);
+
+    for (int y = 0; y < half_height; y++) {
+        int y0 = 2 * y, y1 = std::min(2 * y + 1, height - 1);
+
+        for (int x = 0; x < half_width; x++) {
+            int x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+
+            for (int c = 0; c < channels; c++) {
+                float sum = decode(above[channels * ((size_t) y0 * width + x0) + c]) + decode(above[channels * ((size_t) y0 * width + x1) + c]) +
+                            decode(above[channels * ((size_t) y1 * width + x0) + c]) + decode(above[channels * ((size_t) y1 * width + x1) + c]);
+                result[channels * ((size_t) y * half_width + x) + c] = encode(0.25f * sum);
+            }
+        }
+    }
+
+    return result;
+}
+
+// Tile files start with this. The size and modification time of the image
+// tell whether the tiles were written from the image as it is now.
+struct TileFileHeader {
+    char magic[8];
+    int32_t format, srgb, tile_size, width, height;
+    int64_t image_bytes, image_time;
+};
+
+static const char tile_file_magic[8] = { 'R', 'T', 'T', 'I', 'L', 'E', 'S', '1' };
+
+// Uses the tile file if its header matches and it holds the whole pyramid.
+bool ImageTexture::open_tile_file(const std::string &tile_path, const TileFileHeader &header) {
+    FILE *file = fopen(tile_path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    TileFileHeader existing;
+    if (fread(&existing, sizeof(existing), 1, file) != 1 || memcmp(existing.magic, header.magic, 8) != 0 ||
+        existing.format != header.format || existing.srgb != header.srgb || existing.tile_size != header.tile_size ||
+        existing.image_bytes != header.image_bytes || existing.image_time != header.image_time ||
+        existing.width < 1 || existing.height < 1) {
+        fclose(file);
+        return false;
+    }
+
+    add_levels(existing.width, existing.height);
+
+    struct stat file_stat;
+    if (fstat(fileno(file), &file_stat) != 0 || (size_t) file_stat.st_size != sizeof(existing) + size_bytes()) {
+        levels.clear();
+        fclose(file);
+        return false;
+    }
+
+    tile_file = file;
+    return true;
+}
+
+// Images from different directories can share a name, so the name of the
+// tile file has a hash of the image's full path in it as well.
+std::string ImageTexture::tile_file_name() const {
+    char *full_path = realpath(path.c_str(), nullptr);
+    std::string name = full_path ? full_path : path;
+    free(full_path);
+
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash = (hash ^ (unsigned char) c) * 1099511628211ull;
     }
+
+    size_t slash = path.find_last_of('/');
+    char hash_string[17];
+    snprintf(hash_string, sizeof(hash_string), "%016llx", (unsigned long long) hash);
+
+    return tile_directory + "/" + path.substr(slash == std::string::npos ? 0 : slash + 1) + "." + hash_string + "." +
+           texture_format_name(format) + (srgb ? "" : ".linear") + ".tiles";
 }
 
-Vec3 ImageTexture::value(const Vec2 &t, const Vec3 &p) {
-    int x = width * t.x;
-    int y = height * t.y;
+// stb_image records why it failed in a global, so images are decoded one
+// at a time even when lookups on different threads convert them at once.
+static std::mutex decode_mutex;
+
+void ImageTexture::convert() {
+    std::call_once(converted, [this]() { convert_image(); });
+}
+
+// Only two levels are in memory at a time. 8-bit levels are averaged in
+// linear space and encoded again. Tile files in tile_directory are written
+// to a temporary name and renamed, so that other processes loading the same
+// image never see a partly written one.
+void ImageTexture::convert_image() {
+    std::unique_lock<std::mutex> decode_lock(decode_mutex);
+
+    ImageFormat image_format;
+    bool is_hdr = (image_format_from_path(path.c_str(), image_format) && is_hdr_format(image_format)) || stbi_is_hdr(path.c_str());
+    int width = 0, height = 0, channels = 3, n;
+
+    if (!is_hdr && stbi_info(path.c_str(), &width, &height, &n)) {
+        channels = n <= 2 ? 1 : 3;
+    }
+
+    if (is_hdr) {
+        format = TEXTURE_FORMAT_RGB16F;
+    }
+    else if (channels == 1) {
+        format = TEXTURE_FORMAT_R8;
+    }
+    else {
+        format = compressed ? TEXTURE_FORMAT_BC1 : TEXTURE_FORMAT_RGB8;
+    }
+
+    decode_table = srgb ? srgb_decode_table() : linear_decode_table();
+    tile_bytes = texture_tile_bytes(format, TextureTile::size);
+
+    TileFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, tile_file_magic, 8);
+    header.format = format;
+    header.srgb = srgb;
+    header.tile_size = TextureTile::size;
+
+    struct stat image_stat;
+    if (stat(path.c_str(), &image_stat) == 0) {
+        header.image_bytes = image_stat.st_size;
+        header.image_time = (int64_t) image_stat.st_mtim.tv_sec * 1000000000 + image_stat.st_mtim.tv_nsec;
+    }
+
+    std::string tile_path = tile_directory.empty() ? "" : tile_file_name();
+    if (!tile_path.empty() && open_tile_file(tile_path, header)) {
+        return;
+    }
+
+    std::vector<unsigned char> bytes;
+    std::vector<float> floats;
+
+    if (is_hdr && image_format_from_path(path.c_str(), image_format) && is_hdr_format(image_format)) {
+        if (!read_image(path.c_str(), width, height, floats)) {
+            floats.clear();
+        }
+    }
+    else if (is_hdr) {
+        float *data = stbi_loadf(path.c_str(), &width, &height, &n, 3);
+        if (data) {
+            floats.assign(data, data + 3 * (size_t) width * height);
+            stbi_image_free(data);
+        }
+    }
+    else {
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &n, channels);
+        if (data) {
+            bytes.assign(data, data + channels * (size_t) width * height);
+            stbi_image_free(data);
+        }
+    }
 
-    unsigned char r = data[3 * (x * height + y) + 0]; 
-    unsigned char g = data[3 * (x * height + y) + 1]; 
-    unsigned char b = data[3 * (x * height + y) + 2]; 
+    decode_lock.unlock();
+
+    if (bytes.empty() && floats.empty()) {
+        fprintf(stderr, "Could not load image '%s'\n", path.c_str());
+        return;
+    }
+
+    header.width = width;
+    header.height = height;
+    add_levels(width, height);
+
+    std::string temporary_path = tile_path + "." + std::to_string(getpid()) + ".tmp";
+    if (!tile_path.empty()) {
+        tile_file = fopen(temporary_path.c_str(), "w+b");
+        if (!tile_file) {
+            fprintf(stderr, "Could not write a tile file for '%s' to '%s', using a temporary one\n", path.c_str(), tile_directory.c_str());
+        }
+    }
+    bool persistent = tile_file != nullptr;
+
+    if (!tile_file) {
+        tile_file = tmpfile();
+    }
+    if (!tile_file) {
+        fprintf(stderr, "Could not create a tile file for '%s'\n", path.c_str());
+        levels.clear();
+        return;
+    }
+
+    fwrite(&header, sizeof(header), 1, tile_file);
+
+    const float *table = decode_table;
+    auto decode_byte = [table](unsigned char v) { return table[v]; };
+    auto encode_byte = [this](float v) { return srgb ? encode_srgb(v) : encode_linear(v); };
+    auto identity = [](float v) { return v; };
+
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (i > 0) {
+            const MipLevel &above = levels[i - 1];
+            if (floats.empty()) {
+                bytes = downsample(bytes, above.width, above.height, channels, decode_byte, encode_byte);
+            }
+            else {
+                floats = downsample(floats, above.width, above.height, channels, identity, identity);
+            }
+        }
+
+        write_tiles(floats.empty() ? (const void*) &bytes[0] : (const void*) &floats[0], channels, levels[i]);
+    }
+
+    if (fflush(tile_file) != 0 || ferror(tile_file)) {
+        fprintf(stderr, "Could not write the tile file for '%s'\n", path.c_str());
+        fclose(tile_file);
+        tile_file = nullptr;
+        levels.clear();
+    }
+
+    // The open file stays readable even if it cannot be renamed and is
+    // removed instead.
+    if (persistent && (!tile_file || rename(temporary_path.c_str(), tile_path.c_str()) != 0)) {
+        remove(temporary_path.c_str());
+    }
+}
+
+// Tiles go to the file by rows of tiles. Texels outside the level are
+// copies of the nearest edge texel, which keeps edge blocks from wasting
+// colors on padding.
+void ImageTexture::write_tiles(const void *texels, int channels, const MipLevel &level) {
+    const int size = TextureTile::size;
+    std::vector<unsigned char> row(tile_bytes * level.tiles_x);
+
+    for (int tile_y = 0; tile_y < level.tiles_y; tile_y++) {
+        for (int tile_x = 0; tile_x < level.tiles_x; tile_x++) {
+            unsigned char *tile = &row[tile_bytes * tile_x];
+
+            for (int ty = 0; ty < size; ty++) {
+                int y = std::min(tile_y * size + ty, level.height - 1);
+
+                for (int tx = 0; tx < size; tx++) {
+                    int x = std::min(tile_x * size + tx, level.width - 1);
+                    size_t source = channels * ((size_t) y * level.width + x);
+                    int i = ty * size + tx;
+
+                    if (format == TEXTURE_FORMAT_RGB16F) {
+                        uint16_t *half = (uint16_t*) tile;
+                        for (int c = 0; c < 3; c++) {
+                            half[3 * i + c] = float_to_half(((const float*) texels)[source + c]);
+                        }
+                    }
+                    else if (format == TEXTURE_FORMAT_R8) {
+                        tile[i] = ((const unsigned char*) texels)[source];
+                    }
+                    else if (format == TEXTURE_FORMAT_RGB8) {
+                        memcpy(&tile[3 * i], &((const unsigned char*) texels)[source], 3);
+                    }
+                }
+            }
+
+            if (format == TEXTURE_FORMAT_BC1) {
+                for (int block_y = 0; block_y < size / 4; block_y++) {
+                    for (int block_x = 0; block_x < size / 4; block_x++) {
+                        unsigned char rgb[16 * 3];
+
+                        for (int i = 0; i < 16; i++) {
+                            int y = std::min(tile_y * size + 4 * block_y + i / 4, level.height - 1);
+                            int x = std::min(tile_x * size + 4 * block_x + i % 4, level.width - 1);
+                            memcpy(&rgb[3 * i], &((const unsigned char*) texels)[3 * ((size_t) y * level.width + x)], 3);
+                        }
+
+                        encode_bc1_block(rgb, &tile[8 * (block_y * (size / 4) + block_x)]);
+                    }
+                }
+            }
+        }
+
+        fwrite(&row[0], 1, row.size(), tile_file);
+    }
+}
+
+size_t ImageTexture::size_bytes() const {
+    if (levels.empty()) {
+        return 0;
+    }
+
+    const MipLevel &last = levels.back();
+    return tile_bytes * (size_t) (last.first_tile + (long long) last.tiles_x * last.tiles_y);
+}
+
+void ImageTexture::read_tile(int level, int tile_x, int tile_y, TextureTile &tile) const {
+    const MipLevel &l = levels[level];
+    off_t offset = sizeof(TileFileHeader) + (off_t) (l.first_tile + (long long) tile_y * l.tiles_x + tile_x) * tile_bytes;
+    tile.data.resize(tile_bytes);
+
+    if (!tile_file || pread(fileno(tile_file), &tile.data[0], tile_bytes, offset) != (ssize_t) tile_bytes) {
+        memset(&tile.data[0], 0, tile_bytes);
+    }
+}
+
+// Every thread keeps the last few tiles it used, indexed by a hash of
+// their keys, and only asks the shared cache for the others.
+struct RecentTile {
+    uint64_t key;
+    std::shared_ptr<const TextureTile> tile;
+    const unsigned char *data;
+};
+
+static const int num_recent_tiles = 16;
+static thread_local RecentTile recent_tiles[num_recent_tiles];
+
+const unsigned char *ImageTexture::find_tile(int level, int tile_x, int tile_y) const {
+    uint64_t key = TextureCache::tile_key(id, level, tile_x, tile_y);
+    RecentTile &recent = recent_tiles[(key ^ (key >> 15) ^ (key >> 31)) % num_recent_tiles];
+
+    if (recent.key != key || !recent.tile) {
+        recent.tile = cache->find(this, level, tile_x, tile_y);
+        recent.data = &recent.tile->data[0];
+        recent.key = key;
+    }
+
+    return recent.data;
+}
+
+// Texel (x, y) of a tile.
+Vec3 ImageTexture::decode(const unsigned char *data, int x, int y) const {
+    const int size = TextureTile::size;
+
+    if (format == TEXTURE_FORMAT_RGB8) {
+        const unsigned char *t = &data[3 * (y * size + x)];
+        return Vec3(decode_table[t[0]], decode_table[t[1]], decode_table[t[2]]);
+    }
+    else if (format == TEXTURE_FORMAT_R8) {
+        float v = decode_table[data[y * size + x]];
+        return Vec3(v, v, v);
+    }
+    else if (format == TEXTURE_FORMAT_RGB16F) {
+        const uint16_t *t = (const uint16_t*) &data[6 * (y * size + x)];
+        return Vec3(half_to_float(t[0]), half_to_float(t[1]), half_to_float(t[2]));
+    }
+
+    unsigned char t[3];
+    decode_bc1_texel(&data[8 * ((y / 4) * (size / 4) + x / 4)], 4 * (y % 4) + x % 4, t);
+    return Vec3(decode_table[t[0]], decode_table[t[1]], decode_table[t[2]]);
+}
+
+// Texel (x, y) of a level, counting rows from the top of the image and
+// wrapping coordinates outside it.
+Vec3 ImageTexture::texel(int level, int x, int y) const {
+    const MipLevel &l = levels[level];
+    x %= l.width;
+    y %= l.height;
+    x = x < 0 ? x + l.width : x;
+    y = y < 0 ? y + l.height : y;
+
+    const int size = TextureTile::size;
+    return decode(find_tile(level, x / size, y / size), x % size, y % size);
+}
+
+// s and t are in texels of the level, with texel centers at half integers.
+Vec3 ImageTexture::bilinear(int level, float s, float t) const {
+    s -= 0.5;
+    t -= 0.5;
+    float x0 = floorf(s), y0 = floorf(t);
+    float fx = s - x0, fy = t - y0;
+    int x = (int) x0, y = (int) y0;
+
+    // Most of the time all four texels are in one tile, which is then
+    // only looked up once.
+    const MipLevel &l = levels[level];
+    const int size = TextureTile::size;
+    if (x >= 0 && y >= 0 && x + 1 < l.width && y + 1 < l.height && x % size != size - 1 && y % size != size - 1) {
+        const unsigned char *data = find_tile(level, x / size, y / size);
+        int tx = x % size, ty = y % size;
+
+        return ((1.0 - fx) * (1.0 - fy)) * decode(data, tx, ty) + (fx * (1.0 - fy)) * decode(data, tx + 1, ty) +
+               ((1.0 - fx) * fy) * decode(data, tx, ty + 1) + (fx * fy) * decode(data, tx + 1, ty + 1);
+    }
+
+    return ((1.0 - fx) * (1.0 - fy)) * texel(level, x, y) + (fx * (1.0 - fy)) * texel(level, x + 1, y) +
+           ((1.0 - fx) * fy) * texel(level, x, y + 1) + (fx * fy) * texel(level, x + 1, y + 1);
+}
+
+// Picks the two levels whose texels are closest to the longer of the
+// differentials, as graphics hardware does, and blends bilinear lookups in
+// both.
+Vec3 ImageTexture::trilinear(const TextureCoord &t) const {
+    float width = levels[0].width, height = levels[0].height;
+    float dx = (width * t.dx.x) * (width * t.dx.x) + (height * t.dx.y) * (height * t.dx.y);
+    float dy = (width * t.dy.x) * (width * t.dy.x) + (height * t.dy.y) * (height * t.dy.y);
+    float level = 0.5 * log2f(fmaxf(fmaxf(dx, dy), 1e-16));
+    float u = t.uv.x, v = 1.0 - t.uv.y;
+
+    if (level <= 0.0) {
+        return bilinear(0, u * levels[0].width, v * levels[0].height);
+    }
+    if (level >= levels.size() - 1) {
+        return texel(levels.size() - 1, 0, 0);
+    }
+
+    int i = (int) level;
+    float f = level - i;
+    const MipLevel &l0 = levels[i], &l1 = levels[i + 1];
+
+    return (1.0 - f) * bilinear(i, u * l0.width, v * l0.height) + f * bilinear(i + 1, u * l1.width, v * l1.height);
+}
+
+// Elliptically weighted averaging, as in pbrt: the footprint is the
+// ellipse the differentials span, filtered with a Gaussian on the level
+// where its minor axis covers a texel or two.
+Vec3 ImageTexture::ewa(const TextureCoord &t) const {
+    // In texels of the first level, where rows run down the image.
+    float width = levels[0].width, height = levels[0].height;
+    Vec2 axis0(width * t.dx.x, -height * t.dx.y), axis1(width * t.dy.x, -height * t.dy.y);
+    float length0 = axis0.x * axis0.x + axis0.y * axis0.y;
+    float length1 = axis1.x * axis1.x + axis1.y * axis1.y;
+
+    if (length0 < length1) {
+        std::swap(axis0, axis1);
+        std::swap(length0, length1);
+    }
+
+    float major_length = sqrtf(length0), minor_length = sqrtf(length1);
+
+    if (minor_length * max_anisotropy < major_length && minor_length > 0.0) {
+        float scale = major_length / (minor_length * max_anisotropy);
+        axis1 = Vec2(scale * axis1.x, scale * axis1.y);
+        minor_length *= scale;
+    }
+
+    float u = t.uv.x, v = 1.0 - t.uv.y;
+
+    if (minor_length == 0.0) {
+        return bilinear(0, u * width, v * height);
+    }
+
+    float level = fmaxf(0.0, log2f(minor_length));
+    int i = (int) level;
+    float f = level - i;
+
+    return (1.0 - f) * ewa_level(i, u, v, axis0, axis1) + f * ewa_level(i + 1, u, v, axis0, axis1);
+}
+
+Vec3 ImageTexture::ewa_level(int level, float s, float t, Vec2 axis0, Vec2 axis1) const {
+    if (level >= (int) levels.size() - 1) {
+        return texel(levels.size() - 1, 0, 0);
+    }
+
+    const MipLevel &l = levels[level];
+    float scale_s = (float) l.width / levels[0].width, scale_t = (float) l.height / levels[0].height;
+    s = s * l.width - 0.5;
+    t = t * l.height - 0.5;
+    axis0 = Vec2(scale_s * axis0.x, scale_t * axis0.y);
+    axis1 = Vec2(scale_s * axis1.x, scale_t * axis1.y);
+
+    // The implicit ellipse a s^2 + b s t + c t^2 = 1, with a texel added to
+    // each axis so that a footprint never falls between texels.
+    float a = axis0.y * axis0.y + axis1.y * axis1.y + 1.0;
+    float b = -2.0 * (axis0.x * axis0.y + axis1.x * axis1.y);
+    float c = axis0.x * axis0.x + axis1.x * axis1.x + 1.0;
+    float inverse_f = 1.0 / (a * c - 0.25 * b * b);
+    a *= inverse_f;
+    b *= inverse_f;
+    c *= inverse_f;
+
+    float determinant = 4.0 * a * c - b * b;
+    float s_extent = 2.0 * sqrtf(determinant * c) / determinant;
+    float t_extent = 2.0 * sqrtf(determinant * a) / determinant;
+    int s0 = (int) ceilf(s - s_extent), s1 = (int) floorf(s + s_extent);
+    int t0 = (int) ceilf(t - t_extent), t1 = (int) floorf(t + t_extent);
+
+    Vec3 sum(0.0, 0.0, 0.0);
+    float weight_sum = 0.0;
+
+    for (int y = t0; y <= t1; y++) {
+        float dt = y - t;
+
+        for (int x = s0; x <= s1; x++) {
+            float ds = x - s;
+            float r2 = a * ds * ds + b * ds * dt + c * dt * dt;
+
+            if (r2 < 1.0) {
+                float weight = ewa_weights.table[(int) (r2 * (EwaWeights::size - 1) + 0.5f)];
+                sum = sum + weight * texel(level, x, y);
+                weight_sum += weight;
+            }
+        }
+    }
+
+    return weight_sum > 0.0 ? (1.0 / weight_sum) * sum : texel(level, (int) floorf(s + 0.5), (int) floorf(t + 0.5));
+}
+
+Vec3 ImageTexture::value(const TextureCoord &t, const Vec3 &) {
+    convert();
+
+    if (levels.empty()) {
+        return Vec3(0.0, 0.0, 0.0);
+    }
+
+    if (filter == TEXTURE_FILTER_NEAREST) {
+        float u = t.uv.x, v = 1.0 - t.uv.y;
+        return texel(0, (int) floorf(u * levels[0].width), (int) floorf(v * levels[0].height));
+    }
+    else if (filter == TEXTURE_FILTER_BILINEAR) {
+        return bilinear(0, t.uv.x * levels[0].width, (1.0 - t.uv.y) * levels[0].height);
+    }
+    else if (filter == TEXTURE_FILTER_EWA) {
+        return ewa(t);
+    }
 
-    return Vec3(r / 255.0, g / 255.0, b / 255.0);
+    return trilinear(t);
 }
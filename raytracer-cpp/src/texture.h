@@ -1,47 +1,157 @@
 #pragma once
 
 #include <math.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "vec3.h"
 #include "stb_image.h"
+#include "texture_cache.h"
+#include "texture_format.h"
 
+// A texture coordinate together with how it changes from one pixel to the
+// next, dx across the image and dy down it, which sets how much of a
+// texture a lookup has to filter. Zero differentials ask for a point
+// sample.
+class TextureCoord {
+    public:
+        Vec2 uv, dx, dy;
+
+        TextureCoord() { };
+
+        TextureCoord(const Vec2 &uv) {
+            this->uv = uv;
+        };
+};
+
+enum TextureType {
+    TEXTURE_CONSTANT,
+    TEXTURE_CHECKERED,
+    TEXTURE_IMAGE
+};
+
+// Textures describe what the scene file says, and are looked up through
+// the ShadingGraph compiled from them, which tells them apart by type.
 class Texture {
     public:
-        virtual Vec3 value(const Vec2 &t, const Vec3 &p) = 0;
+        TextureType type;
+
+        Texture(TextureType type) {
+            this->type = type;
+        };
+
+        virtual ~Texture() { };
 };
 
 class ConstantTexture : public Texture {
     public:
         Vec3 color;
 
-        ConstantTexture(const Vec3 &color) {
+        ConstantTexture(const Vec3 &color) : Texture(TEXTURE_CONSTANT) {
             this->color = color;
         };
-
-        Vec3 value(const Vec2 &t, const Vec3 &p);
 };
 
+// texture0 where sin(10 x) sin(10 y) sin(10 z) is negative and texture1
+// elsewhere, so the two alternate in cubes pi / 10 wide.
 class CheckeredTexture : public Texture {
     public:
         Texture *texture0, *texture1;
 
-        CheckeredTexture(Texture *texture0, Texture *texture1) {
+        CheckeredTexture(Texture *texture0, Texture *texture1) : Texture(TEXTURE_CHECKERED) {
             this->texture0 = texture0;
             this->texture1 = texture1;
         };
+};
 
-        Vec3 value(const Vec2 &t, const Vec3 &p);
+enum TextureFilter {
+    TEXTURE_FILTER_NEAREST,
+    TEXTURE_FILTER_BILINEAR,
+    TEXTURE_FILTER_TRILINEAR,
+    TEXTURE_FILTER_EWA
 };
 
+// Returns false for an unknown name.
+bool parse_texture_filter(const char *name, TextureFilter &filter);
+
+struct TileFileHeader;
+
+// An image with a MIP pyramid, each level half the size of the one before
+// down to a single texel. Coordinates wrap around, and v = 0 is the bottom
+// row of the image. The constructor only reads the file's header, and
+// convert(), called on the first lookup unless called before, writes the
+// pyramid as tiles to a tile file. From there tiles are read into the
+// texture cache as lookups need them, so the memory textures take is the
+// cache's whatever their number and size. The tile file is a temporary one
+// that goes away with the texture, unless tile_directory is set. Tile files
+// there are used again as long as the image and the settings they were
+// written with stay the same, so later loads skip decoding.
+//
+// Tiles are stored in the most compact format that fits the image: half
+// floats for HDR images, one channel for grayscale ones, and 8-bit RGB or
+// BC1 blocks if compressed is set. 8-bit values are sRGB encoded unless
+// srgb is cleared. These settings have to be made before convert().
 class ImageTexture : public Texture {
+    private:
+        struct MipLevel {
+            int width, height;
+            int tiles_x, tiles_y;
+            // Of the level's first tile in the tile file.
+            long long first_tile;
+        };
+
+        std::string path;
+        bool readable_file;
+        std::vector<MipLevel> levels;
+        TextureCache *cache;
+        FILE *tile_file;
+        size_t tile_bytes;
+        const float *decode_table;
+        std::once_flag converted;
+
+        std::string tile_file_name() const;
+        bool open_tile_file(const std::string &tile_path, const TileFileHeader &header);
+        void add_levels(int width, int height);
+        void convert_image();
+        void write_tiles(const void *texels, int channels, const MipLevel &level);
+        const unsigned char *find_tile(int level, int tile_x, int tile_y) const;
+        Vec3 decode(const unsigned char *data, int x, int y) const;
+        Vec3 texel(int level, int x, int y) const;
+        Vec3 bilinear(int level, float s, float t) const;
+        Vec3 trilinear(const TextureCoord &t) const;
+        Vec3 ewa(const TextureCoord &t) const;
+        Vec3 ewa_level(int level, float s, float t, Vec2 axis0, Vec2 axis1) const;
+
     public:
-        int width, height;
-        unsigned char *data;
+        TextureFilter filter;
+        bool srgb, compressed;
+        TextureFormat format;
+        int id;
+        // Where to keep the tile file for later loads, or empty for a
+        // temporary one.
+        std::string tile_directory;
+
+        ImageTexture(const char *image_file_name, TextureFilter filter, TextureCache *cache);
+        ~ImageTexture();
 
-        ImageTexture(const char *image_file_name) {
-            int n;
-            data = stbi_load(image_file_name, &width, &height, &n, 3);
+        // Whether the file looks like an image this can decode.
+        bool readable() const {
+            return readable_file;
         };
 
-        Vec3 value(const Vec2 &t, const Vec3 &p);
+        // Decodes the image and writes its tiles, unless the tile file from
+        // an earlier load can be used. Only the first call does anything, and
+        // lookups after it failed to decode the image are black.
+        void convert();
+
+        // Of the whole pyramid, once it has been converted.
+        size_t size_bytes() const;
+
+        // Reads a tile of the pyramid, which must have been converted.
+        // Tiles of an image that failed to decode are black.
+        void read_tile(int level, int tile_x, int tile_y, TextureTile &tile) const;
+
+        Vec3 value(const TextureCoord &t, const Vec3 &p);
 };
@@ -0,0 +1,77 @@
+#include "texture_cache.h"
+#include "texture.h"
+
+int TextureCache::add_texture() {
+    static std::atomic<int> next_id(1);
+    return next_id++;
+}
+
+std::shared_ptr<const TextureTile> TextureCache::find(const ImageTexture *texture, int level, int tile_x, int tile_y) {
+    uint64_t key = tile_key(texture->id, level, tile_x, tile_y);
+    Shard &s = shard(key);
+
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.entries.find(key);
+
+        if (it != s.entries.end()) {
+            s.num_hits++;
+            s.recent.splice(s.recent.begin(), s.recent, it->second.recent);
+            return it->second.tile;
+        }
+    }
+
+    std::shared_ptr<TextureTile> tile = std::make_shared<TextureTile>();
+    texture->read_tile(level, tile_x, tile_y, *tile);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.entries.find(key);
+    s.num_misses++;
+
+    // Another thread read the same tile in the meantime.
+    if (it != s.entries.end()) {
+        return it->second.tile;
+    }
+
+    s.recent.push_front(key);
+    s.entries[key] = { tile, s.recent.begin() };
+    s.bytes += tile->data.size();
+    evict(s);
+    return tile;
+}
+
+void TextureCache::evict(Shard &s) {
+    size_t shard_capacity = capacity / num_shards;
+
+    while (s.bytes > shard_capacity && !s.recent.empty()) {
+        auto it = s.entries.find(s.recent.back());
+        s.bytes -= it->second.tile->data.size();
+        s.entries.erase(it);
+        s.recent.pop_back();
+        s.num_evictions++;
+    }
+}
+
+// Not safe while other threads use the cache.
+void TextureCache::set_capacity(size_t capacity_bytes) {
+    capacity = capacity_bytes;
+
+    for (Shard &s : shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        evict(s);
+    }
+}
+
+TextureCacheStats TextureCache::stats() {
+    TextureCacheStats result = { 0, 0, 0, 0 };
+
+    for (Shard &s : shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        result.hits += s.num_hits;
+        result.misses += s.num_misses;
+        result.evictions += s.num_evictions;
+        result.bytes += s.bytes;
+    }
+
+    return result;
+}
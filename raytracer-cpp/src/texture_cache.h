@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ImageTexture;
+
+// A square of texels of one MIP level, in the format of its texture.
+// Tiles at the right and bottom edges of a level are padded.
+class TextureTile {
+    public:
+        static const int size = 32;
+        std::vector<unsigned char> data;
+};
+
+// Hits and misses count the lookups that get past the few tiles each
+// thread keeps at hand.
+struct TextureCacheStats {
+    long long hits, misses, evictions;
+    size_t bytes;
+};
+
+// Holds the most recently used tiles of every image texture, up to a fixed
+// number of bytes of texels, and reads the rest from their textures as
+// they are needed. Shared by all threads: tiles never change once read,
+// and a tile that is evicted stays alive while a thread still holds it.
+// Tiles are spread over shards by a hash of their keys, each with its own
+// lock, its own least recently used order and an equal part of the
+// capacity, so that threads looking up different tiles rarely wait on
+// each other.
+class TextureCache {
+    private:
+        struct Entry {
+            std::shared_ptr<const TextureTile> tile;
+            std::list<uint64_t>::iterator recent;
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<uint64_t, Entry> entries;
+            // Most recently used first.
+            std::list<uint64_t> recent;
+            size_t bytes;
+            long long num_hits, num_misses, num_evictions;
+        };
+
+        static const int num_shards = 16;
+        Shard shards[num_shards];
+        size_t capacity;
+
+        Shard &shard(uint64_t key) {
+            return shards[(key * 0x9e3779b97f4a7c15ull) >> 60];
+        };
+
+        void evict(Shard &s);
+
+    public:
+        static const size_t default_capacity = 64 << 20;
+
+        TextureCache() {
+            this->capacity = default_capacity;
+
+            for (Shard &shard : shards) {
+                shard.bytes = 0;
+                shard.num_hits = 0;
+                shard.num_misses = 0;
+                shard.num_evictions = 0;
+            }
+        };
+
+        TextureCache(const TextureCache&) = delete;
+        TextureCache &operator=(const TextureCache&) = delete;
+
+        // Returns the id a texture identifies its tiles by, unique among
+        // all caches.
+        static int add_texture();
+
+        static uint64_t tile_key(int texture_id, int level, int tile_x, int tile_y) {
+            return ((uint64_t) texture_id << 40) | ((uint64_t) level << 32) | ((uint64_t) tile_y << 16) | (uint64_t) tile_x;
+        };
+
+        // Reads the tile from the texture on a miss, without holding the
+        // cache locked, so threads missing on different tiles read them at
+        // the same time.
+        std::shared_ptr<const TextureTile> find(const ImageTexture *texture, int level, int tile_x, int tile_y);
+
+        void set_capacity(size_t capacity_bytes);
+
+        size_t capacity_bytes() const {
+            return capacity;
+        };
+
+        TextureCacheStats stats();
+};
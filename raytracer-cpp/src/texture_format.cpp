@@ -0,0 +1,270 @@
+#include <math.h>
+#include <algorithm>
+
+#include "texture_format.h"
+
+const char *texture_format_name(TextureFormat format) {
+    static const char *names[] = { "rgb8", "r8", "rgb16f", "bc1" };
+    return names[format];
+}
+
+size_t texture_tile_bytes(TextureFormat format, int size) {
+    size_t texels = (size_t) size * size;
+
+    if (format == TEXTURE_FORMAT_R8) {
+        return texels;
+    }
+    else if (format == TEXTURE_FORMAT_RGB16F) {
+        return 6 * texels;
+    }
+    else if (format == TEXTURE_FORMAT_BC1) {
+        return texels / 2;
+    }
+    return 3 * texels;
+}
+
+class DecodeTables {
+    public:
+        float srgb[256], linear[256];
+
+        DecodeTables() {
+            for (int i = 0; i < 256; i++) {
+                double v = i / 255.0;
+                srgb[i] = v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+                linear[i] = v;
+            }
+        };
+};
+
+static const DecodeTables decode_tables;
+
+const float *srgb_decode_table() {
+    return decode_tables.srgb;
+}
+
+const float *linear_decode_table() {
+    return decode_tables.linear;
+}
+
+// Searches the codes by the midpoints between their values.
+unsigned char encode_srgb(float linear) {
+    const float *table = decode_tables.srgb;
+    int low = 0, high = 255;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (linear > 0.5f * (table[middle] + table[middle + 1])) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+unsigned char encode_linear(float linear) {
+    float v = linear > 0.0 ? (linear < 1.0 ? linear : 1.0) : 0.0;
+    return (unsigned char) (v * 255.0 + 0.5);
+}
+
+static int to_565(const float *rgb) {
+    int r = std::min(std::max((int) (rgb[0] * 31.0 / 255.0 + 0.5), 0), 31);
+    int g = std::min(std::max((int) (rgb[1] * 63.0 / 255.0 + 0.5), 0), 63);
+    int b = std::min(std::max((int) (rgb[2] * 31.0 / 255.0 + 0.5), 0), 31);
+    return (r << 11) | (g << 5) | b;
+}
+
+// Picks the nearest of the block's four colors for every texel and returns
+// the squared error, with the colors exactly as decode_bc1_texel() makes
+// them.
+static int assign_bc1_indices(const unsigned char *rgb, unsigned char *block, int *indices) {
+    unsigned char palette[4][3];
+    for (int i = 0; i < 4; i++) {
+        block[4] = i;
+        decode_bc1_texel(block, 0, palette[i]);
+    }
+
+    int error = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, best_error = 1 << 30;
+
+        for (int j = 0; j < 4; j++) {
+            int dr = rgb[3 * i] - palette[j][0], dg = rgb[3 * i + 1] - palette[j][1], db = rgb[3 * i + 2] - palette[j][2];
+            int e = dr * dr + dg * dg + db * db;
+
+            if (e < best_error) {
+                best = j;
+                best_error = e;
+            }
+        }
+
+        indices[i] = best;
+        error += best_error;
+    }
+
+    return error;
+}
+
+static void set_bc1_block(unsigned char *block, int c0, int c1) {
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+}
+
+// Solves for the endpoints that fit the texels best by least squares,
+// given how far along the line from the first endpoint to the second each
+// texel's index puts it. Returns false if the fit is degenerate.
+static bool fit_bc1_endpoints(const unsigned char *rgb, const int *indices, unsigned char *block) {
+    static const float weights[4] = { 1.0, 0.0, 2.0 / 3.0, 1.0 / 3.0 };
+    float aa = 0.0, ab = 0.0, bb = 0.0, ax[3] = { 0.0, 0.0, 0.0 }, bx[3] = { 0.0, 0.0, 0.0 };
+
+    for (int i = 0; i < 16; i++) {
+        float a = weights[indices[i]], b = 1.0 - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++) {
+            ax[c] += a * rgb[3 * i + c];
+            bx[c] += b * rgb[3 * i + c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) < 1e-6) {
+        return false;
+    }
+
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; c++) {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+    }
+
+    int c0 = to_565(e0), c1 = to_565(e1);
+    if (c0 == c1) {
+        return false;
+    }
+
+    set_bc1_block(block, std::max(c0, c1), std::min(c0, c1));
+    return true;
+}
+
+// Endpoints start at the extremes of the texels along their principal
+// axis and are then refit to the indices they give, for as long as that
+// lowers the error. The first endpoint is always the larger,
+// for four colors and no transparent black.
+void encode_bc1_block(const unsigned char *rgb, unsigned char *block) {
+    float mean[3] = { 0.0, 0.0, 0.0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += rgb[3 * i + c] / 16.0;
+        }
+    }
+
+    float covariance[3][3] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[3] = { rgb[3 * i] - mean[0], rgb[3 * i + 1] - mean[1], rgb[3 * i + 2] - mean[2] };
+        for (int a = 0; a < 3; a++) {
+            for (int b = 0; b < 3; b++) {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+
+    float axis[3] = { 1.0, 1.0, 1.0 };
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3];
+        for (int a = 0; a < 3; a++) {
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+        }
+
+        float length = fmaxf(fabsf(next[0]), fmaxf(fabsf(next[1]), fabsf(next[2])));
+        if (length == 0.0) {
+            break;
+        }
+        for (int a = 0; a < 3; a++) {
+            axis[a] = next[a] / length;
+        }
+    }
+
+    float min_t = 1e30, max_t = -1e30;
+    for (int i = 0; i < 16; i++) {
+        float t = (rgb[3 * i] - mean[0]) * axis[0] + (rgb[3 * i + 1] - mean[1]) * axis[1] + (rgb[3 * i + 2] - mean[2]) * axis[2];
+        min_t = fminf(min_t, t);
+        max_t = fmaxf(max_t, t);
+    }
+
+    float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; c++) {
+        e0[c] = mean[c] + max_t * axis[c] / axis_length2;
+        e1[c] = mean[c] + min_t * axis[c] / axis_length2;
+    }
+
+    int c0 = to_565(e0), c1 = to_565(e1);
+    int indices[16];
+    int error = 1 << 30;
+
+    if (c0 != c1) {
+        set_bc1_block(block, std::max(c0, c1), std::min(c0, c1));
+        error = assign_bc1_indices(rgb, block, indices);
+
+        for (int pass = 0; pass < 4; pass++) {
+            unsigned char refined[8];
+            int refined_indices[16];
+
+            if (!fit_bc1_endpoints(rgb, indices, refined)) {
+                break;
+            }
+
+            int refined_error = assign_bc1_indices(rgb, refined, refined_indices);
+            if (refined_error >= error) {
+                break;
+            }
+
+            memcpy(block, refined, 4);
+            memcpy(indices, refined_indices, sizeof(indices));
+            error = refined_error;
+        }
+    }
+    else {
+        set_bc1_block(block, c0, c0);
+        for (int i = 0; i < 16; i++) {
+            indices[i] = 0;
+        }
+    }
+
+    for (int row = 0; row < 4; row++) {
+        block[4 + row] = indices[4 * row] | (indices[4 * row + 1] << 2) | (indices[4 * row + 2] << 4) | (indices[4 * row + 3] << 6);
+    }
+}
+
+#ifndef __F16C__
+// Rounds to nearest even, with overflow to infinity and small values to
+// subnormals.
+uint16_t float_to_half(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477ff000) {
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {
+        float subnormal;
+        memcpy(&subnormal, &magnitude, 4);
+        return sign | (uint16_t) lrintf(subnormal * 16777216.0f);
+    }
+
+    uint32_t rounded = magnitude + 0xfff + ((magnitude >> 13) & 1);
+    return sign | (uint16_t) ((rounded - 0x38000000) >> 13);
+}
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// How the texels of texture tiles are stored. Tiles are always read back
+// as linear RGB.
+enum TextureFormat {
+    // 8 bits per channel, decoded through a table.
+    TEXTURE_FORMAT_RGB8,
+    // One 8-bit channel, for grayscale images like masks and roughness
+    // maps, read as gray.
+    TEXTURE_FORMAT_R8,
+    // Half floats, for HDR images.
+    TEXTURE_FORMAT_RGB16F,
+    // BC1 blocks of 4x4 texels in 8 bytes: two RGB565 colors and a 2-bit
+    // index per texel into the four colors evenly spaced between them.
+    TEXTURE_FORMAT_BC1
+};
+
+const char *texture_format_name(TextureFormat format);
+
+// Bytes a square tile of size texels on a side takes. size is a multiple
+// of 4.
+size_t texture_tile_bytes(TextureFormat format, int size);
+
+// The linear values of the 256 8-bit sRGB codes, and of the 256 codes of
+// 8-bit linear data.
+const float *srgb_decode_table();
+const float *linear_decode_table();
+
+// The code whose linear value is closest.
+unsigned char encode_srgb(float linear);
+unsigned char encode_linear(float linear);
+
+// Compresses 16 RGB texels, by rows, into a BC1 block.
+void encode_bc1_block(const unsigned char *rgb, unsigned char *block);
+
+// Texel i of a BC1 block, as 8-bit values.
+inline void decode_bc1_texel(const unsigned char *block, int i, unsigned char *rgb) {
+    int c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    int index = (block[4 + i / 4] >> (2 * (i % 4))) & 3;
+    int r0 = (c0 >> 11) & 31, g0 = (c0 >> 5) & 63, b0 = c0 & 31;
+    int r1 = (c1 >> 11) & 31, g1 = (c1 >> 5) & 63, b1 = c1 & 31;
+    int e0[3] = { (r0 << 3) | (r0 >> 2), (g0 << 2) | (g0 >> 4), (b0 << 3) | (b0 >> 2) };
+    int e1[3] = { (r1 << 3) | (r1 >> 2), (g1 << 2) | (g1 >> 4), (b1 << 3) | (b1 >> 2) };
+
+    // The weights of the endpoints in thirds, or in halves with black as
+    // the fourth color when the first endpoint is not the larger.
+    static const int weights[2][4][3] = {
+        { { 2, 0, 2 }, { 0, 2, 2 }, { 1, 1, 2 }, { 0, 0, 1 } },
+        { { 3, 0, 3 }, { 0, 3, 3 }, { 2, 1, 3 }, { 1, 2, 3 } }
+    };
+    const int *w = weights[c0 > c1][index];
+
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = (w[0] * e0[c] + w[1] * e1[c]) / w[2];
+    }
+}
+
+#ifdef __F16C__
+inline float half_to_float(uint16_t h) {
+    return _cvtsh_ss(h);
+}
+
+inline uint16_t float_to_half(float f) {
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+}
+#else
+inline float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 31, mantissa = h & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else {
+        // Zero or subnormal: mantissa * 2^-24.
+        float f = mantissa * (1.0f / 16777216.0f);
+        memcpy(&bits, &f, 4);
+        bits |= sign;
+    }
+
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+uint16_t float_to_half(float f);
+#endif
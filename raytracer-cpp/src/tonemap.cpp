@@ -0,0 +1,88 @@
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+#include "tonemap.h"
+
+bool parse_tonemap_operator(const char *name, TonemapOperator &op) {
+    if (strcmp(name, "clamp") == 0) {
+        op = TONEMAP_CLAMP;
+    }
+    else if (strcmp(name, "reinhard") == 0) {
+        op = TONEMAP_REINHARD;
+    }
+    else if (strcmp(name, "aces") == 0) {
+        op = TONEMAP_ACES;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+static int srgb_code(float linear) {
+    double srgb = linear <= 0.0031308 ? 12.92 * linear : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+    return (int) (255.0 * srgb + 0.5);
+}
+
+// Starts from the inverse transfer function at the boundary between two
+// codes and steps to the neighbouring floats until the threshold is the
+// first float that rounds up.
+void Tonemapper::build_table() {
+    srgb_thresholds[0] = 0.0;
+
+    for (int k = 1; k < 256; k++) {
+        double srgb = (k - 0.5) / 255.0;
+        float t = srgb <= 0.04045 ? srgb / 12.92 : pow((srgb + 0.055) / 1.055, 2.4);
+
+        while (srgb_code(t) >= k) {
+            t = nextafterf(t, 0.0f);
+        }
+        while (srgb_code(t) < k) {
+            t = nextafterf(t, 1.0f);
+        }
+
+        srgb_thresholds[k] = t;
+    }
+}
+
+void Tonemapper::apply(const float *rgb, size_t count, unsigned char *out) const {
+    const Float8 scale(powf(2.0, exposure));
+    const Float8 zero(0.0f), one(1.0f);
+
+    for (size_t i = 0; i < count; i += 8) {
+        int n = count - i < 8 ? count - i : 8;
+        float tail[8] = { 0.0 };
+
+        if (n < 8) {
+            memcpy(tail, &rgb[i], n * sizeof(float));
+        }
+
+        Float8 x = Float8::load(n < 8 ? tail : &rgb[i]) * scale;
+
+        if (op == TONEMAP_REINHARD) {
+            x = x / (one + vmax(x, zero));
+        }
+        else if (op == TONEMAP_ACES) {
+            // Curve fit of the ACES filmic tonemapper, "ACES Filmic Tone
+            // Mapping Curve" (Narkowicz 2015).
+            x = (x * (Float8(2.51f) * x + Float8(0.03f))) / (x * (Float8(2.43f) * x + Float8(0.59f)) + Float8(0.14f));
+        }
+
+        // max() comes first and returns its second operand for NaN, which
+        // turns NaN into black.
+        x = vmin(vmax(x, zero), one);
+
+        float linear[8];
+        x.store(linear);
+
+        for (int k = 0; k < n; k++) {
+            int code = 0;
+            for (int step = 128; step > 0; step >>= 1) {
+                code += linear[k] >= srgb_thresholds[code + step] ? step : 0;
+            }
+            out[i + k] = code;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+enum TonemapOperator {
+    TONEMAP_CLAMP,
+    TONEMAP_REINHARD,
+    TONEMAP_ACES
+};
+
+// Returns false for an unknown name.
+bool parse_tonemap_operator(const char *name, TonemapOperator &op);
+
+// Maps linear HDR values to 8-bit sRGB: scales by 2^exposure, compresses
+// with the operator and encodes with the sRGB transfer function.
+class Tonemapper {
+    private:
+        // srgb_thresholds[k] is the smallest linear value that rounds to
+        // sRGB code k or above, for k from 1 to 255, so that a binary search
+        // finds the exactly rounded code of any value.
+        float srgb_thresholds[256];
+
+        void build_table();
+
+    public:
+        TonemapOperator op;
+        float exposure;
+
+        Tonemapper(TonemapOperator op, float exposure) {
+            this->op = op;
+            this->exposure = exposure;
+            build_table();
+        };
+
+        // Converts count floats, eight at a time.
+        void apply(const float *rgb, size_t count, unsigned char *out) const;
+};
@@ -0,0 +1,220 @@
+#include <chrono>
+
+#include "triangle_mesh.h"
+
+// Watertight ray/triangle intersection, see "Watertight Ray/Triangle
+// Intersection" (Woop, Benthin and Wald 2013). The ray is sheared so that
+// it runs along +z, after which rays through an edge or a vertex shared by
+// several triangles hit exactly one of them.
+class TriangleRay {
+    public:
+        Vec3 origin;
+        int kx, ky, kz;
+        float sx, sy, sz;
+
+        TriangleRay(const Ray &ray) {
+            Vec3 d = ray.direction;
+            Vec3 abs_d(fabs(d.x), fabs(d.y), fabs(d.z));
+
+            kz = abs_d.x > abs_d.y ? (abs_d.x > abs_d.z ? 0 : 2) : (abs_d.y > abs_d.z ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (d[kz] < 0.0) {
+                std::swap(kx, ky);
+            }
+
+            origin = ray.origin;
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1.0 / d[kz];
+        };
+
+        // On a hit closer than t_max, returns t and the barycentric
+        // coordinates of p1 and p2.
+        bool intersect(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2, float t_max, float &t, Vec2 &uv) const;
+};
+
+bool TriangleRay::intersect(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2, float t_max, float &t, Vec2 &uv) const {
+    Vec3 a = p0 - origin;
+    Vec3 b = p1 - origin;
+    Vec3 c = p2 - origin;
+
+    float ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+    float bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+    float cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    // An edge function of exactly zero is redone in double precision, which
+    // settles which of the triangles sharing the edge the ray hits.
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = (float) ((double) cx * by - (double) cy * bx);
+        v = (float) ((double) ax * cy - (double) ay * cx);
+        w = (float) ((double) bx * ay - (double) by * ax);
+    }
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) {
+        return false;
+    }
+
+    float det = u + v + w;
+    if (det == 0.0f) {
+        return false;
+    }
+
+    float scaled_t = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+
+    // Both faces are hit, so the signs of det and scaled_t only have to agree.
+    if (det < 0.0f) {
+        det = -det;
+        scaled_t = -scaled_t;
+    }
+    if (scaled_t <= 0.0f || scaled_t >= t_max * det) {
+        return false;
+    }
+
+    float inverse_det = 1.0f / det;
+    t = scaled_t * inverse_det;
+    uv = Vec2(fabs(v) * inverse_det, fabs(w) * inverse_det);
+    return true;
+}
+
+void TriangleMesh::build(int max_leaf_size) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    int n = num_triangles();
+    std::vector<AABB> boxes(n);
+    std::vector<int> order;
+
+    for (int i = 0; i < n; i++) {
+        AABB box = AABB::merge(AABB(), positions[indices[3 * i + 0]]);
+        box = AABB::merge(box, positions[indices[3 * i + 1]]);
+        boxes[i] = AABB::merge(box, positions[indices[3 * i + 2]]);
+    }
+
+    depth = build_bvh(boxes, max_leaf_size, nodes, order);
+
+    std::vector<int> reordered(indices.size());
+    for (int i = 0; i < n; i++) {
+        reordered[3 * i + 0] = indices[3 * order[i] + 0];
+        reordered[3 * i + 1] = indices[3 * order[i] + 1];
+        reordered[3 * i + 2] = indices[3 * order[i] + 2];
+    }
+    indices.swap(reordered);
+
+    auto end_time = std::chrono::steady_clock::now();
+    build_time = std::chrono::duration<double>(end_time - start_time).count();
+}
+
+bool TriangleMesh::intersect(const Ray &ray, float t_max, Hit &hit) {
+    TriangleRay triangle_ray(ray);
+    bool did_hit = false;
+
+    traverse_bvh(nodes, ray, t_max, [&](const BVHNode &node) {
+        for (int i = node.offset; i < node.offset + node.count; i++) {
+            const int *triangle = &indices[3 * i];
+            float t;
+            Vec2 uv;
+
+            if (triangle_ray.intersect(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]], t_max, t, uv)) {
+                hit.set(t, this, i);
+                hit.uv = uv;
+                t_max = t;
+                did_hit = true;
+            }
+        }
+        return false;
+    });
+
+    return did_hit;
+}
+
+bool TriangleMesh::occluded(const Ray &ray, float t_max) {
+    TriangleRay triangle_ray(ray);
+    bool blocked = false;
+
+    traverse_bvh(nodes, ray, t_max, [&](const BVHNode &node) {
+        for (int i = node.offset; i < node.offset + node.count && !blocked; i++) {
+            const int *triangle = &indices[3 * i];
+            float t;
+            Vec2 uv;
+
+            blocked = triangle_ray.intersect(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]], t_max, t, uv);
+        }
+        return blocked;
+    });
+
+    return blocked;
+}
+
+// The position is interpolated from the vertices rather than found along
+// the ray, and pushed off the surface towards the ray's side, so that rays
+// leaving it do not hit the same triangle again.
+void TriangleMesh::finalize(const Ray &ray, const Hit &hit, HitRecord &record) {
+    const int *triangle = &indices[3 * hit.primitive];
+    float b1 = hit.uv.x, b2 = hit.uv.y, b0 = 1.0 - b1 - b2;
+
+    const Vec3 &p0 = positions[triangle[0]];
+    const Vec3 &p1 = positions[triangle[1]];
+    const Vec3 &p2 = positions[triangle[2]];
+
+    Vec3 normal = Vec3::normalize(Vec3::cross(p1 - p0, p2 - p0));
+    if (Vec3::dot(normal, ray.direction) > 0.0) {
+        normal = -1.0 * normal;
+    }
+
+    Vec3 position = b0 * p0 + b1 * p1 + b2 * p2;
+    float magnitude = fmaxf(fmaxf(fabs(position.x), fabs(position.y)), fabs(position.z));
+    record.position = position + (1e-5f * (magnitude + 1.0f)) * normal;
+
+    record.normal = normal;
+    if (!normals.empty()) {
+        Vec3 shading_normal = b0 * normals[triangle[0]] + b1 * normals[triangle[1]] + b2 * normals[triangle[2]];
+
+        if (Vec3::dot(shading_normal, shading_normal) > 0.0) {
+            shading_normal = Vec3::normalize(shading_normal);
+            record.normal = Vec3::dot(shading_normal, normal) < 0.0 ? -1.0 * shading_normal : shading_normal;
+        }
+    }
+
+    // Without texture coordinates the barycentrics stand in for them, and
+    // the edges from p0 are how position moves with them.
+    record.dpdu = p1 - p0;
+    record.dpdv = p2 - p0;
+
+    if (!texture_coords.empty()) {
+        const Vec2 &t0 = texture_coords[triangle[0]];
+        const Vec2 &t1 = texture_coords[triangle[1]];
+        const Vec2 &t2 = texture_coords[triangle[2]];
+        record.texture_coord = TextureCoord(Vec2(b0 * t0.x + b1 * t1.x + b2 * t2.x, b0 * t0.y + b1 * t1.y + b2 * t2.y));
+
+        float du1 = t1.x - t0.x, dv1 = t1.y - t0.y;
+        float du2 = t2.x - t0.x, dv2 = t2.y - t0.y;
+        float determinant = du1 * dv2 - dv1 * du2;
+
+        if (fabs(determinant) > 1e-12) {
+            float inverse_det = 1.0 / determinant;
+            record.dpdu = inverse_det * (dv2 * (p1 - p0) - dv1 * (p2 - p0));
+            record.dpdv = inverse_det * (du1 * (p2 - p0) - du2 * (p1 - p0));
+        }
+        else {
+            record.dpdu = Vec3(0.0, 0.0, 0.0);
+            record.dpdv = Vec3(0.0, 0.0, 0.0);
+        }
+    }
+    else {
+        record.texture_coord = TextureCoord(hit.uv);
+    }
+
+    record.material = material;
+}
+
+AABB TriangleMesh::bounding_box() {
+    if (nodes.empty()) {
+        return AABB();
+    }
+
+    return nodes[0].box;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "bvh_tree.h"
+#include "hitables.h"
+
+// Triangles sharing indexed vertex buffers, three indices per triangle.
+// normals and texture_coords are either empty or have one entry per
+// position. The mesh is a single hitable to the scene and has its own BVH
+// over its triangles, which build() makes and reorders indices for.
+class TriangleMesh : public Hitable {
+    public:
+        std::vector<Vec3> positions;
+        std::vector<Vec3> normals;
+        std::vector<Vec2> texture_coords;
+        std::vector<int> indices;
+        std::vector<BVHNode> nodes;
+        int depth;
+        double build_time;
+
+        TriangleMesh() {
+            this->depth = 0;
+            this->build_time = 0.0;
+        };
+
+        int num_triangles() const {
+            return indices.size() / 3;
+        };
+
+        void build(int max_leaf_size = 4);
+
+        bool intersect(const Ray &ray, float t_max, Hit &hit);
+        AABB bounding_box();
+        bool occluded(const Ray &ray, float t_max);
+        void finalize(const Ray &ray, const Hit &hit, HitRecord &record);
+};
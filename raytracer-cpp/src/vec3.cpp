@@ -1,4 +1,5 @@
 #include "vec3.h"
+#include "sampler.h"
 
 Vec3 operator+(const Vec3 &u, const Vec3 &v) {
     return Vec3(u.x + v.x, u.y + v.y, u.z + v.z);
@@ -12,6 +13,10 @@ Vec3 operator*(float s, const Vec3 &v) {
     return Vec3(s * v.x, s * v.y, s * v.z);
 }
 
+Vec3 operator*(const Vec3 &u, const Vec3 &v) {
+    return Vec3(u.x * v.x, u.y * v.y, u.z * v.z);
+}
+
 Vec3 Vec3::normalize(const Vec3 &v) {
     float l = Vec3::length(v);
 
@@ -42,21 +47,56 @@ Vec3 Vec3::cross(const Vec3 &v1, const Vec3 &v2) {
 }
 
 // http://mathworld.wolfram.com/DiskPointPicking.html
-Vec3 Vec3::random_in_unit_disk() {
-    float r = RAND(0.0, 1.0);     
-    float theta = RAND(0.0, 2.0 * M_PI);
+Vec3 Vec3::random_in_unit_disk(Sampler &sampler) {
+    float r = sampler.next_1d();
+    float theta = 2.0 * M_PI * sampler.next_1d();
     return Vec3(r * cos(theta), r * sin(theta), 0.0);
 }
 
 // http://math.stackexchange.com/questions/87230/picking-random-points-in-the-volume-of-sphere-with-uniform-probability
-Vec3 Vec3::random_in_unit_sphere() {
-    float x = RAND(-1.0, 1.0);
-    float y = RAND(-1.0, 1.0);
-    float z = RAND(-1.0, 1.0);
-    float u = RAND(0.0, 1.0);
+Vec3 Vec3::random_in_unit_sphere(Sampler &sampler) {
+    float x = 2.0 * sampler.next_1d() - 1.0;
+    float y = 2.0 * sampler.next_1d() - 1.0;
+    float z = 2.0 * sampler.next_1d() - 1.0;
+    float u = sampler.next_1d();
     return pow(u, 1.0 / 3.0) * Vec3::normalize(Vec3(x, y, z));
 }
 
+// "Building an Orthonormal Basis, Revisited" (Duff et al. 2017).
+void Vec3::orthonormal_basis(const Vec3 &normal, Vec3 &tangent, Vec3 &bitangent) {
+    float sign = copysignf(1.0, normal.z);
+    float a = -1.0 / (sign + normal.z);
+    float b = normal.x * normal.y * a;
+    tangent = Vec3(1.0 + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    bitangent = Vec3(b, sign + normal.y * normal.y * a, -normal.y);
+}
+
+// Maps (u1, u2) onto a cosine weighted direction in the hemisphere around
+// the normal.
+Vec3 Vec3::sample_cosine_hemisphere(const Vec3 &normal, float u1, float u2) {
+    Vec3 tangent, bitangent;
+    orthonormal_basis(normal, tangent, bitangent);
+
+    float r = sqrt(u1);
+    float phi = 2.0 * M_PI * u2;
+    float z = sqrt(fmaxf(0.0, 1.0 - u1));
+
+    return (r * cos(phi)) * tangent + (r * sin(phi)) * bitangent + z * normal;
+}
+
+// Maps (u1, u2) onto a uniformly distributed direction in the cone of
+// directions within acos(cos_theta_max) of the axis.
+Vec3 Vec3::sample_cone(const Vec3 &axis, float cos_theta_max, float u1, float u2) {
+    Vec3 tangent, bitangent;
+    orthonormal_basis(axis, tangent, bitangent);
+
+    float cos_theta = 1.0 - u1 * (1.0 - cos_theta_max);
+    float sin_theta = sqrt(fmaxf(0.0, 1.0 - cos_theta * cos_theta));
+    float phi = 2.0 * M_PI * u2;
+
+    return (sin_theta * cos(phi)) * tangent + (sin_theta * sin(phi)) * bitangent + cos_theta * axis;
+}
+
 Vec3 Vec3::clamp(const Vec3 &v, float min, float max) {
     Vec3 result = v;
 
@@ -84,14 +124,7 @@ Vec3 Vec3::clamp(const Vec3 &v, float min, float max) {
     return result;
 }
 
-Vec3 Vec3::rotate_x(const Vec3 &v, float cos_theta, float sin_theta) {
-    return Vec3(v.x, cos_theta * v.y - sin_theta * v.z, sin_theta * v.y + cos_theta * v.z);
-}
-
-Vec3 Vec3::rotate_y(const Vec3 &v, float cos_theta, float sin_theta) {
-    return Vec3(cos_theta * v.x + sin_theta * v.z, v.y, -sin_theta * v.x + cos_theta * v.z);
-}
-
-Vec3 Vec3::rotate_z(const Vec3 &v, float cos_theta, float sin_theta) {
-    return Vec3(cos_theta * v.x - sin_theta * v.y, sin_theta * v.x + cos_theta * v.y, v.z);
+// Rec. 709 luminance of a linear RGB color.
+float Vec3::luminance(const Vec3 &v) {
+    return 0.2126 * v.x + 0.7152 * v.y + 0.0722 * v.z;
 }
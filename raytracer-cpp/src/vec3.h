@@ -3,7 +3,7 @@
 #include <math.h>
 #include <stdlib.h>
 
-#define RAND(a, b) ((a) + (((b) - (a)) * ((rand() % 10000) / 10000.0)))
+class Sampler;
 
 class Vec3 {
     public:
@@ -21,22 +21,28 @@ class Vec3 {
             this->z = z;
         };
 
+        float operator[](int i) const {
+            return (&x)[i];
+        };
+
         static float length(const Vec3 &v);
         static Vec3 normalize(const Vec3 &v);
         static Vec3 reflect(const Vec3 &v, const Vec3 &n);
         static float dot(const Vec3 &v1, const Vec3 &v2);
         static Vec3 cross(const Vec3 &v1, const Vec3 &v2);
-        static Vec3 random_in_unit_disk();
-        static Vec3 random_in_unit_sphere();
+        static Vec3 random_in_unit_disk(Sampler &sampler);
+        static Vec3 random_in_unit_sphere(Sampler &sampler);
+        static void orthonormal_basis(const Vec3 &normal, Vec3 &tangent, Vec3 &bitangent);
+        static Vec3 sample_cosine_hemisphere(const Vec3 &normal, float u1, float u2);
+        static Vec3 sample_cone(const Vec3 &axis, float cos_theta_max, float u1, float u2);
         static Vec3 clamp(const Vec3 &v, float min, float max);
-        static Vec3 rotate_x(const Vec3 &v, float cos_theta, float sin_theta);
-        static Vec3 rotate_y(const Vec3 &v, float cos_theta, float sin_theta);
-        static Vec3 rotate_z(const Vec3 &v, float cos_theta, float sin_theta);
+        static float luminance(const Vec3 &v);
 };
 
 Vec3 operator+(const Vec3 &u, const Vec3 &v);
 Vec3 operator-(const Vec3 &u, const Vec3 &v);
 Vec3 operator*(float s, const Vec3 &v);
+Vec3 operator*(const Vec3 &u, const Vec3 &v);
 
 class Vec2 {
     public: